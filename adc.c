@@ -0,0 +1,99 @@
+#include "hal.h"
+#include "adc.h"
+#include "timebase.h"
+
+// Each extra bit of resolution costs 4x the samples
+_Static_assert(ADC_OVERSAMPLE == 1 << (2 * (ADC_BITS - 10)), "ADC_OVERSAMPLE does not match ADC_BITS");
+_Static_assert(ADC_OVERSAMPLE % HAL_ADC_BURST == 0, "ADC_OVERSAMPLE must be whole bursts");
+
+static volatile unsigned int adc_out;
+static volatile unsigned int adc_last;
+
+// Decimator and filter state, touched only by adc_isr()
+static unsigned int adc_acc;
+static int adc_acc_n;
+#if ADC_FILTER == ADC_FILTER_MEDIAN
+static unsigned int adc_window[ADC_MEDIAN_N];
+static int adc_window_pos;
+static int adc_window_n;
+#elif ADC_FILTER == ADC_FILTER_EMA
+static unsigned int adc_ema;
+static int adc_ema_primed;
+#endif
+
+void adc_init(unsigned char channel)
+{
+    // Timer3 is shared with the seven-segment DMA at the same 250 us period
+    hal_timer3_event_init(T5_TCKPS, T5_PR);
+    hal_adc_stream(channel, 3);
+}
+
+#if ADC_FILTER == ADC_FILTER_MEDIAN
+static unsigned int adc_median(void)
+{
+    unsigned int v[ADC_MEDIAN_N];
+    int i, j;
+
+    // Insertion sort of a handful of values, cheaper than anything clever
+    for (i = 0; i < adc_window_n; i++) {
+        unsigned int x = adc_window[i];
+
+        for (j = i; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+    return v[adc_window_n / 2];
+}
+#endif
+
+static unsigned int adc_filter(unsigned int x)
+{
+#if ADC_FILTER == ADC_FILTER_MEDIAN
+    adc_window[adc_window_pos] = x;
+    adc_window_pos = (adc_window_pos + 1) % ADC_MEDIAN_N;
+    if (adc_window_n < ADC_MEDIAN_N)
+        adc_window_n++;
+    return adc_median();
+#elif ADC_FILTER == ADC_FILTER_EMA
+    // Kept scaled by 2^ADC_EMA_SHIFT so the fraction is not lost
+    if (!adc_ema_primed) {
+        adc_ema = x << ADC_EMA_SHIFT;
+        adc_ema_primed = 1;
+    } else {
+        adc_ema = adc_ema - (adc_ema >> ADC_EMA_SHIFT) + x;
+    }
+    return adc_ema >> ADC_EMA_SHIFT;
+#else
+    return x;
+#endif
+}
+
+void adc_isr(void)
+{
+    unsigned int burst[HAL_ADC_BURST];
+    int i;
+
+    hal_adc_burst(burst);
+    for (i = 0; i < HAL_ADC_BURST; i++)
+        adc_acc += burst[i];
+    adc_last = burst[HAL_ADC_BURST - 1];
+
+    adc_acc_n += HAL_ADC_BURST;
+    if (adc_acc_n == ADC_OVERSAMPLE) {
+        // Sum of 16 10-bit samples is 14 bits; dropping 2 leaves 12 effective bits
+        adc_out = adc_filter(adc_acc >> (ADC_BITS - 10));
+        adc_acc = 0;
+        adc_acc_n = 0;
+    }
+    hal_adc_ack();
+}
+
+unsigned int adc_value(void)
+{
+    return adc_out;
+}
+
+unsigned int adc_raw(void)
+{
+    return adc_last;
+}
@@ -0,0 +1,30 @@
+#ifndef ADC_H
+#define ADC_H
+
+// Background ADC pipeline: Timer3 triggers a conversion every 250 us, the ADC
+// interrupt collects them eight at a time, oversamples 16 of them into one
+// 12-bit value (~250 Hz) and runs that through the filter selected below.
+// adc_value() is a single load, main() never waits on the converter.
+
+#define ADC_FILTER_NONE   0   // decimated value as is
+#define ADC_FILTER_MEDIAN 1   // median of the last ADC_MEDIAN_N decimated values
+#define ADC_FILTER_EMA    2   // exponential moving average, alpha = 1 / 2^ADC_EMA_SHIFT
+
+#ifndef ADC_FILTER
+#define ADC_FILTER ADC_FILTER_EMA
+#endif
+
+#define ADC_OVERSAMPLE 16     // 4^2 samples -> 2 extra bits
+#define ADC_MEDIAN_N   5
+#define ADC_EMA_SHIFT  3
+
+#define ADC_BITS       12
+#define ADC_MAX        ((1 << ADC_BITS) - 1)
+
+void adc_init(unsigned char channel);
+void adc_isr(void);           // ADC interrupt
+
+unsigned int adc_value(void); // filtered, 0..ADC_MAX; 0 until the first decimation
+unsigned int adc_raw(void);   // last single conversion, 0..1023
+
+#endif
@@ -0,0 +1,259 @@
+#include "hal.h"
+#include "fsm.h"
+#include "keypad.h"
+#include "adc.h"
+#include "idle.h"
+#include "prof.h"
+#include "replay.h"
+#include "switches.h"
+
+#define FSM_QUEUE_SIZE 16   // power of two
+#define FSM_STEP_TICKS (TB_TICKS_PER_US * T5_TICK_US)   // core timer ticks per step
+
+// Filled and drained by main() only: the sources below are polled, not ISRs
+static struct fsm_event fsm_q[FSM_QUEUE_SIZE];
+static unsigned char fsm_q_head;
+static unsigned char fsm_q_tail;
+
+static const struct fsm_state *fsm_table;
+static int fsm_current;
+static int fsm_next;
+static int (*fsm_work)(void);
+
+// Logical time: one step per Timer5 tick, see fsm_run()
+static uint32_t fsm_step;
+static uint32_t fsm_seen;            // tb_tick_count() the last step was taken for
+
+static int fsm_timer_armed;
+static uint32_t fsm_timer_deadline;  // in steps
+
+static int fsm_frames_on;
+static struct frame_clock fsm_clock;
+
+static int fsm_adc_on;
+static int fsm_adc_in;
+static unsigned int fsm_adc_lo;
+static unsigned int fsm_adc_hi;
+
+static int fsm_sw0;
+static unsigned int fsm_switches;    // levels after the switch edges drained so far
+static uint32_t fsm_sw_lost;
+static uint32_t fsm_sw0_stamp;       // tb_ticks() of the SW0 edge behind fsm_switches
+static unsigned int fsm_adc;         // sampled adc_value(), low bits cleared
+
+static void fsm_post(unsigned char type, unsigned char arg)
+{
+    unsigned char next = (fsm_q_head + 1) & (FSM_QUEUE_SIZE - 1);
+
+    if (next == fsm_q_tail)
+        return;   // a state this far behind would not use the event anyway
+    fsm_q[fsm_q_head].type = type;
+    fsm_q[fsm_q_head].arg = arg;
+    fsm_q_head = next;
+}
+
+static int fsm_get(struct fsm_event *ev)
+{
+    if (fsm_q_tail == fsm_q_head)
+        return 0;
+    *ev = fsm_q[fsm_q_tail];
+    fsm_q_tail = (fsm_q_tail + 1) & (FSM_QUEUE_SIZE - 1);
+    return 1;
+}
+
+// This step's inputs: from the pins, or from the stream when replaying
+static void fsm_sample(struct replay_input *in)
+{
+    struct key_event key;
+    struct sw_edge edge;
+
+    // Levels follow the queued edges, so the stamp belongs to the level seen
+    while (sw_get_edge(&edge)) {
+        fsm_switches = (fsm_switches & ~(1u << edge.index)) | ((unsigned int)edge.level << edge.index);
+        if (edge.index == 0)
+            fsm_sw0_stamp = edge.stamp;
+    }
+    if (sw_lost() != fsm_sw_lost) {
+        fsm_sw_lost = sw_lost();
+        fsm_switches = SW_LEVELS(sw_snapshot());
+    }
+
+    in->sw0 = fsm_switches & 1;
+    in->adc = (unsigned char)(adc_value() >> (ADC_BITS - 8));
+    in->keys = 0;
+    while (keypad_get_event(&key))
+        if (key.type == KEY_PRESS && in->keys < REPLAY_KEYS)
+            in->key[in->keys++] = key.code;
+    replay_step(fsm_step, in);
+    fsm_adc = (unsigned int)in->adc << (ADC_BITS - 8);
+}
+
+static void fsm_poll(void)
+{
+    struct replay_input sample;
+    int i, in;
+
+    fsm_sample(&sample);
+    for (i = 0; i < sample.keys; i++)
+        fsm_post(FSM_EV_KEY, sample.key[i]);
+
+    if (sample.sw0 != fsm_sw0) {
+        fsm_sw0 = sample.sw0;
+        fsm_post(FSM_EV_SW0, sample.sw0);
+    }
+
+    if (fsm_adc_on) {
+        in = fsm_adc >= fsm_adc_lo && fsm_adc <= fsm_adc_hi;
+        if (in != fsm_adc_in) {
+            fsm_adc_in = in;
+            fsm_post(FSM_EV_ADC, (unsigned char)in);
+        }
+    }
+
+    if (fsm_timer_armed && (int32_t)(fsm_step - fsm_timer_deadline) >= 0) {
+        fsm_timer_armed = 0;
+        fsm_post(FSM_EV_TIMER, 0);
+    }
+}
+
+// Leave the current state and enter the pending one until that settles
+static void fsm_transition(void)
+{
+    while (fsm_next != fsm_current) {
+        const struct fsm_state *from = &fsm_table[fsm_current];
+        const struct fsm_state *to = &fsm_table[fsm_next];
+
+        if (from->exit)
+            from->exit();
+        fsm_current = fsm_next;
+
+        // Nothing queued for the old state carries over
+        fsm_q_tail = fsm_q_head;
+        keypad_flush();
+        fsm_timer_armed = 0;
+        fsm_frames_on = 0;
+        fsm_adc_on = 0;
+
+        if (to->enter)
+            to->enter();
+    }
+}
+
+void fsm_run(const struct fsm_state *table, int first)
+{
+    struct replay_input sample;
+    struct fsm_event ev;
+    int i;
+
+    fsm_table = table;
+    fsm_current = fsm_next = first;
+    fsm_step = 0;
+    fsm_seen = tb_tick_count();
+
+    // Step 0 sets the levels without events
+    fsm_switches = SW_LEVELS(sw_snapshot());
+    fsm_sample(&sample);
+    fsm_sw0 = sample.sw0;
+    for (i = 0; i < sample.keys; i++)
+        fsm_post(FSM_EV_KEY, sample.key[i]);
+
+    if (table[first].enter)
+        table[first].enter();
+    fsm_transition();
+
+    for (;;) {
+        const struct fsm_state *s;
+
+        // One step per Timer5 tick. A late main() takes the missed steps one
+        // by one, so inputs, timers and frames line up the same way on every
+        // run and a recorded session replays exactly.
+        if (fsm_seen == tb_tick_count()) {
+            if (!fsm_work || !fsm_work())
+                idle_wait();
+            continue;
+        }
+        fsm_seen++;
+        fsm_step++;
+
+        fsm_poll();
+        while (fsm_get(&ev)) {
+            s = &fsm_table[fsm_current];
+            if (s->event)
+                s->event(&ev);
+            fsm_transition();
+        }
+
+        s = &fsm_table[fsm_current];
+        if (fsm_frames_on && frame_due(&fsm_clock, fsm_step * FSM_STEP_TICKS)) {
+            PROF_ENTER(PROF_FRAME);
+            if (s->tick)
+                s->tick();
+            PROF_LEAVE(PROF_FRAME);
+            frame_end(&fsm_clock);
+            fsm_transition();
+        }
+    }
+}
+
+void fsm_goto(int state)
+{
+    fsm_next = state;
+}
+
+void fsm_background(int (*work)(void))
+{
+    fsm_work = work;
+}
+
+void fsm_timer(uint32_t ms)
+{
+    fsm_timer_deadline = fsm_step + T5_TICKS_MS(ms);
+    fsm_timer_armed = 1;
+}
+
+void fsm_timer_cancel(void)
+{
+    fsm_timer_armed = 0;
+}
+
+void fsm_frames(uint32_t rate_mhz)
+{
+    frame_start(&fsm_clock, rate_mhz, fsm_step * FSM_STEP_TICKS);
+    fsm_frames_on = 1;
+}
+
+void fsm_adc_window(unsigned int lo, unsigned int hi)
+{
+    fsm_adc_lo = lo;
+    fsm_adc_hi = hi;
+    fsm_adc_in = 0;
+    fsm_adc_on = 1;
+}
+
+const struct frame_clock *fsm_frame_clock(void)
+{
+    return &fsm_clock;
+}
+
+uint32_t fsm_now(void)
+{
+    return fsm_step;
+}
+
+int fsm_input_sw0(void)
+{
+    return fsm_sw0;
+}
+
+int fsm_input_sw0_stamp(uint32_t *stamp)
+{
+    if (replay_mode() == REPLAY_PLAY)
+        return 0;
+    *stamp = fsm_sw0_stamp;
+    return 1;
+}
+
+unsigned int fsm_input_adc(void)
+{
+    return fsm_adc;
+}
@@ -0,0 +1,53 @@
+#ifndef FSM_H
+#define FSM_H
+
+// Table-driven state machine for main(). One dispatcher loop turns the
+// board's inputs into events, hands them to the current state and runs the
+// state's tick on its frame clock. Handlers never block: waiting is done
+// with fsm_timer() and the dispatcher idles when nothing is pending.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#define FSM_EV_KEY   1   // arg = key code, presses only
+#define FSM_EV_SW0   2   // arg = new switch level
+#define FSM_EV_ADC   3   // arg = 1 on entering the fsm_adc_window(), 0 on leaving
+#define FSM_EV_TIMER 4   // the fsm_timer() one-shot expired
+
+struct fsm_event {
+    unsigned char type;
+    unsigned char arg;
+};
+
+// Any handler may be NULL
+struct fsm_state {
+    const char *name;                             // for debug output
+    void (*enter)(void);
+    void (*exit)(void);
+    void (*tick)(void);                           // once per frame, see fsm_frames()
+    void (*event)(const struct fsm_event *ev);
+};
+
+void fsm_run(const struct fsm_state *table, int first);   // never returns
+void fsm_goto(int state);          // taken once the running handler returns
+
+// Called when the dispatcher has caught up, before it idles. work() does one
+// short piece and returns nonzero while more is pending.
+void fsm_background(int (*work)(void));
+
+// Per-state resources, all released on every transition
+void fsm_timer(uint32_t ms);                       // one-shot FSM_EV_TIMER
+void fsm_timer_cancel(void);
+void fsm_frames(uint32_t rate_mhz);                // call tick at this rate
+void fsm_adc_window(unsigned int lo, unsigned int hi);   // adc_value() range
+
+const struct frame_clock *fsm_frame_clock(void);
+
+// Logical time and the inputs as sampled this step (replayed when replaying).
+// Handlers read these, never the pins, so a replay sees the same values.
+uint32_t fsm_now(void);                            // steps (Timer5 ticks) since fsm_run()
+int fsm_input_sw0(void);
+int fsm_input_sw0_stamp(uint32_t *stamp);          // tb_ticks() of the SW0 edge, 0 when replaying
+unsigned int fsm_input_adc(void);                  // adc_value() scale, 8 significant bits
+
+#endif
@@ -0,0 +1,59 @@
+#include "game.h"
+
+const uint32_t game_rate_mhz[GAME_SPEEDS] = { GAME_RATE_EASY, GAME_RATE_HARD };
+
+// Spawn interval in cells per entity type
+const unsigned char game_spawn[GAME_SPEEDS][PF_TYPES] = { { 16, 16 }, { 8, 8 } };
+
+void game_start(struct game *g, int speed, int sw0)
+{
+    game_move(g, sw0);
+    g->player_col = 0;
+    g->sub = 0;
+    g->coins = 0;
+    g->frames = 0;
+    g->over = 0;
+
+    // Opening layout: coin at the right edge of row 0, bomb mid-screen on row 1
+    pf_init(&g->pf);
+    pf_place(&g->pf, PF_COIN, 0, 15);
+    pf_place(&g->pf, PF_BOMB, 1, 10);
+    pf_spawner(&g->pf, PF_COIN, game_spawn[speed][PF_COIN], 16, 0);
+    pf_spawner(&g->pf, PF_BOMB, game_spawn[speed][PF_BOMB], 11, 0);
+}
+
+void game_advance(struct game *g)
+{
+    if (g->sub == 0) {
+        pf_step(&g->pf);
+        g->sub = GAME_SUBSTEPS - 1;
+    } else {
+        g->sub--;
+    }
+    g->frames++;
+}
+
+// One AND against the player's column per type
+unsigned int game_collide(struct game *g)
+{
+    unsigned int ev = 0;
+    uint16_t player = PF_BIT(g->player_col);
+
+    if (g->sub != 0)
+        return 0;
+    if (pf_hit(&g->pf, PF_COIN, g->player_row, player, 1)) {
+        g->coins++;
+        ev |= GAME_EV_COIN;
+    }
+    if (pf_hit(&g->pf, PF_BOMB, g->player_row, player, 0)) {
+        g->over = 1;
+        ev |= GAME_EV_BOMB;
+    }
+    return ev;
+}
+
+unsigned int game_frame(struct game *g)
+{
+    game_advance(g);
+    return game_collide(g);
+}
@@ -0,0 +1,55 @@
+#ifndef GAME_H
+#define GAME_H
+
+// Game rules without any I/O: playfield, player and score. main() wraps them
+// with rendering, sound and LEDs; tools/game_mc.c runs them headless to tune
+// the difficulties.
+
+#include <stdint.h>
+#include "playfield.h"
+
+#define GAME_EASY   0
+#define GAME_HARD   1
+#define GAME_SPEEDS 2
+
+// Playfield step rates in mHz
+#define GAME_RATE_EASY 2500   // 400 ms per cell
+#define GAME_RATE_HARD 5556   // ~180 ms per cell
+
+#define GAME_SUBSTEPS 5       // frames per cell, the entities move one pixel per frame
+
+// game_collide() results
+#define GAME_EV_COIN 0x01
+#define GAME_EV_BOMB 0x02
+
+struct game {
+    struct playfield pf;
+    int sub;                  // pixel offset of every entity within its cell
+    unsigned char player_row;
+    unsigned char player_col;
+    unsigned int coins;       // taken this run
+    uint32_t frames;
+    int over;                 // hit a bomb
+};
+
+extern const uint32_t game_rate_mhz[GAME_SPEEDS];
+extern const unsigned char game_spawn[GAME_SPEEDS][PF_TYPES];
+
+// Frames per second in mHz
+static inline uint32_t game_frame_mhz(int speed)
+{
+    return game_rate_mhz[speed] * GAME_SUBSTEPS;
+}
+
+void game_start(struct game *g, int speed, int sw0);
+void game_advance(struct game *g);            // one pixel left, a cell every GAME_SUBSTEPS frames
+unsigned int game_collide(struct game *g);    // GAME_EV_* once entities sit on a cell
+unsigned int game_frame(struct game *g);      // advance + collide, for headless runs
+
+// SW0 up: top row, down: bottom row
+static inline void game_move(struct game *g, int sw0)
+{
+    g->player_row = sw0 ? 0 : 1;
+}
+
+#endif
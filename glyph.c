@@ -0,0 +1,69 @@
+#include "glyph.h"
+#include "lcd.h"
+
+#define LCD_SET_CGRAM 0x40
+
+// 5x8 sprites, one row per byte
+static const unsigned char glyph_rom[GLYPH_COUNT][8] = {
+    [GLYPH_HANDS_DOWN] = { 0x0E, 0x0E, 0x04, 0x04, 0x0E, 0x15, 0x04, 0x0A },
+    [GLYPH_HANDS_UP]   = { 0x0E, 0x04, 0x15, 0x0E, 0x04, 0x04, 0x0A, 0x11 },
+    [GLYPH_DOG]        = { 0x00, 0x0A, 0x1F, 0x15, 0x1F, 0x04, 0x0A, 0x11 },
+    [GLYPH_COIN]       = { 0x00, 0x06, 0x0F, 0x0F, 0x0F, 0x0F, 0x06, 0x00 },
+    [GLYPH_BOMB]       = { 0x04, 0x0A, 0x15, 0x0E, 0x0E, 0x1F, 0x04, 0x0A },
+};
+
+static unsigned char slot_glyph[GLYPH_CACHE_SLOTS];   // glyph id + 1, 0 = empty
+static unsigned int slot_used[GLYPH_CACHE_SLOTS];     // glyph_clock at the last request
+static unsigned int glyph_clock;
+static unsigned int glyph_upload_count;
+static uint32_t glyph_lcd_resets;                    // lcd_resets() the slots belong to
+
+unsigned char glyph_slot(enum glyph_id id)
+{
+    unsigned char victim = 0;
+    int s, i;
+
+    // A re-initialised panel may have lost CGRAM (and dropped queued uploads)
+    if (glyph_lcd_resets != lcd_resets()) {
+        glyph_lcd_resets = lcd_resets();
+        for (s = 0; s < GLYPH_CACHE_SLOTS; s++)
+            slot_glyph[s] = 0;
+    }
+
+    glyph_clock++;
+    for (s = 0; s < GLYPH_CACHE_SLOTS; s++) {
+        if (slot_glyph[s] == id + 1) {
+            slot_used[s] = glyph_clock;
+            return (unsigned char)s;
+        }
+    }
+
+    // Miss: first empty slot, else the least recently used one
+    for (s = 0; s < GLYPH_CACHE_SLOTS; s++) {
+        if (!slot_glyph[s]) {
+            victim = (unsigned char)s;
+            break;
+        }
+        if (slot_used[s] < slot_used[victim])
+            victim = (unsigned char)s;
+    }
+
+    lcd_cmd(LCD_SET_CGRAM | (victim << 3));
+    for (i = 0; i < 8; i++)
+        lcd_data(glyph_rom[id][i]);
+    glyph_upload_count++;
+
+    slot_glyph[victim] = (unsigned char)(id + 1);
+    slot_used[victim] = glyph_clock;
+    return victim;
+}
+
+unsigned int glyph_uploads(void)
+{
+    return glyph_upload_count;
+}
+
+const unsigned char *glyph_bitmap(enum glyph_id id)
+{
+    return glyph_rom[id];
+}
@@ -0,0 +1,27 @@
+#ifndef GLYPH_H
+#define GLYPH_H
+
+// Custom LCD characters. The HD44780 has 8 CGRAM slots; glyph_slot() keeps
+// track of which sprite sits in which slot and uploads only on a miss,
+// replacing the least recently used slot.
+
+enum glyph_id {
+    GLYPH_HANDS_DOWN,
+    GLYPH_HANDS_UP,
+    GLYPH_DOG,
+    GLYPH_COIN,
+    GLYPH_BOMB,
+    GLYPH_COUNT
+};
+
+#define GLYPH_SLOTS       8
+#define GLYPH_CACHE_SLOTS 4   // slots 4..7 are streamed by scroll.c
+
+// Character code (0..7) showing the glyph. A miss queues 9 LCD transfers.
+// Slots requested for the screen being drawn stay valid as long as that
+// screen needs no more than GLYPH_CACHE_SLOTS different glyphs.
+unsigned char glyph_slot(enum glyph_id id);
+unsigned int glyph_uploads(void);
+const unsigned char *glyph_bitmap(enum glyph_id id);   // 8 rows, bit 4 = leftmost pixel
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Hardware abstraction layer for the Basys MX3 arcade game.
+// Every pin and peripheral access in the game goes through this header so the
+// same source builds for the PIC32 (XC32) or for Linux against the register
+// simulator in hal_sim.c (compile with -DHAL_SIM).
+
+#include <stdint.h>
+
+#ifdef HAL_SIM
+#define __ISR(vector, ipl)
+#else
+#include <xc.h>
+#include <sys/attribs.h>
+#endif
+
+// Clock tree, must match the #pragma config bits in pic32_arcade_game.c
+#define HAL_FRC_HZ    8000000UL
+#define HAL_PLL_IDIV  2           // FPLLIDIV = DIV_2
+#define HAL_PLL_MUL   20          // FPLLMUL = MUL_20
+#define HAL_PLL_ODIV  1           // FPLLODIV = DIV_1
+#define HAL_PB_DIV    1           // FPBDIV = DIV_1
+#define HAL_SYSCLK_HZ (HAL_FRC_HZ / HAL_PLL_IDIV * HAL_PLL_MUL / HAL_PLL_ODIV)
+#define HAL_PBCLK_HZ  (HAL_SYSCLK_HZ / HAL_PB_DIV)
+
+// GPIO ports (same order and 0x100 stride as the PIC32 SFR map)
+typedef enum {
+    HAL_PORT_A = 0,
+    HAL_PORT_B,
+    HAL_PORT_C,
+    HAL_PORT_D,
+    HAL_PORT_E,
+    HAL_PORT_F,
+    HAL_PORT_G,
+    HAL_PORT_COUNT
+} hal_port_t;
+
+// Word offsets of the per-port registers from ANSELx
+#define HAL_REG_ANSEL  0
+#define HAL_REG_TRIS   4
+#define HAL_REG_PORT   8
+#define HAL_REG_LAT    12
+#define HAL_REG_ODC    16
+#define HAL_REG_CNPU   20
+#define HAL_REG_CNPD   24
+#define HAL_REG_CNCON  28
+#define HAL_REG_CNEN   32
+#define HAL_REG_CNSTAT 36
+#define HAL_REG_CLR    1   // add to a register offset for its CLR/SET/INV alias
+#define HAL_REG_SET    2
+#define HAL_REG_INV    3
+
+// Board pin map: each name expands to "port, mask"
+#define HAL_PIN_PORT(pin)          HAL_PIN_PORT_(pin)
+#define HAL_PIN_MASK(pin)          HAL_PIN_MASK_(pin)
+#define HAL_PIN_PORT_(port, mask)  (port)
+#define HAL_PIN_MASK_(port, mask)  (mask)
+
+#define PIN_LCD_RS     HAL_PORT_B, (1u << 15)
+#define PIN_LCD_RW     HAL_PORT_D, (1u << 5)
+#define PIN_LCD_EN     HAL_PORT_D, (1u << 4)
+#define PIN_LCD_BUSY   HAL_PORT_E, (1u << 7)
+#define PORT_LCD_DATA  HAL_PORT_E
+
+#define PIN_KEY_ROW1   HAL_PORT_C, (1u << 2)
+#define PIN_KEY_ROW2   HAL_PORT_C, (1u << 1)
+#define PIN_KEY_ROW3   HAL_PORT_C, (1u << 4)
+#define PIN_KEY_ROW4   HAL_PORT_G, (1u << 6)
+#define PIN_KEY_COL1   HAL_PORT_C, (1u << 3)
+#define PIN_KEY_COL2   HAL_PORT_G, (1u << 7)
+#define PIN_KEY_COL3   HAL_PORT_G, (1u << 8)
+#define PIN_KEY_COL4   HAL_PORT_G, (1u << 9)
+
+#define PIN_SW0        HAL_PORT_F, (1u << 3)
+#define PIN_SW1        HAL_PORT_F, (1u << 5)
+#define PIN_SW2        HAL_PORT_F, (1u << 4)
+#define PIN_SW3        HAL_PORT_D, (1u << 15)
+
+#define PIN_BUZZER     HAL_PORT_B, (1u << 14)
+#define PIN_LED_RED    HAL_PORT_D, (1u << 2)
+#define PIN_LED_GREEN  HAL_PORT_D, (1u << 12)
+#define PIN_LED_BLUE   HAL_PORT_D, (1u << 3)
+#define PIN_ADC_AN2    HAL_PORT_B, (1u << 2)
+#define PORT_LEDS      HAL_PORT_A
+#define PIN_UART_TX    HAL_PORT_F, (1u << 12)
+
+#define PIN_SSD_AN0    HAL_PORT_B, (1u << 12)
+#define PIN_SSD_AN1    HAL_PORT_B, (1u << 13)
+#define PIN_SSD_AN2    HAL_PORT_A, (1u << 9)
+#define PIN_SSD_AN3    HAL_PORT_A, (1u << 10)
+#define PIN_SSD_CA     HAL_PORT_G, (1u << 12)
+#define PIN_SSD_CB     HAL_PORT_A, (1u << 14)
+#define PIN_SSD_CC     HAL_PORT_D, (1u << 6)
+#define PIN_SSD_CD     HAL_PORT_G, (1u << 13)
+#define PIN_SSD_CE     HAL_PORT_G, (1u << 15)
+#define PIN_SSD_CF     HAL_PORT_D, (1u << 7)
+#define PIN_SSD_CG     HAL_PORT_D, (1u << 13)
+
+// === Register access ===
+#ifdef HAL_SIM
+uint32_t hal_reg_read(hal_port_t port, int reg);
+void hal_reg_write(hal_port_t port, int reg, uint32_t value);
+void hal_nop(void);
+uint32_t hal_core_timer(void);
+void hal_idle(void);
+uint32_t hal_irq_save(void);
+void hal_irq_restore(uint32_t state);
+unsigned int hal_irq_level(void);
+#else
+#define HAL_SFR(port, reg) (((volatile uint32_t *)&ANSELA)[(port) * 64 + (reg)])
+
+static inline uint32_t hal_reg_read(hal_port_t port, int reg)
+{
+    return HAL_SFR(port, reg);
+}
+
+static inline void hal_reg_write(hal_port_t port, int reg, uint32_t value)
+{
+    HAL_SFR(port, reg) = value;
+}
+
+static inline void hal_nop(void)
+{
+    __asm__ volatile("nop");
+}
+
+// CP0 Count, increments at SYSCLK / 2
+static inline uint32_t hal_core_timer(void)
+{
+    return _CP0_GET_COUNT();
+}
+
+// Stop the core until the next interrupt. OSCCON.SLPEN is left at 0, so this
+// is Idle mode: the clocks and every peripheral keep running.
+static inline void hal_idle(void)
+{
+    __asm__ volatile("wait");
+}
+
+// Short critical sections: mask interrupts, then put back the previous state
+static inline uint32_t hal_irq_save(void)
+{
+    return __builtin_disable_interrupts();
+}
+
+static inline void hal_irq_restore(uint32_t state)
+{
+    if (state & 1)   // Status.IE was set
+        __builtin_enable_interrupts();
+}
+
+// Priority of the running ISR (Status.IPL), 0 in main()
+static inline unsigned int hal_irq_level(void)
+{
+    return (_CP0_GET_STATUS() >> 10) & 7;
+}
+#endif
+
+// === Pin helpers ===
+static inline void hal_output(hal_port_t port, uint32_t mask)  { hal_reg_write(port, HAL_REG_TRIS + HAL_REG_CLR, mask); }
+static inline void hal_input(hal_port_t port, uint32_t mask)   { hal_reg_write(port, HAL_REG_TRIS + HAL_REG_SET, mask); }
+static inline void hal_digital(hal_port_t port, uint32_t mask) { hal_reg_write(port, HAL_REG_ANSEL + HAL_REG_CLR, mask); }
+static inline void hal_analog(hal_port_t port, uint32_t mask)  { hal_reg_write(port, HAL_REG_ANSEL + HAL_REG_SET, mask); }
+static inline void hal_pullup(hal_port_t port, uint32_t mask)  { hal_reg_write(port, HAL_REG_CNPU + HAL_REG_SET, mask); }
+
+static inline void hal_set(hal_port_t port, uint32_t mask)     { hal_reg_write(port, HAL_REG_LAT + HAL_REG_SET, mask); }
+static inline void hal_clr(hal_port_t port, uint32_t mask)     { hal_reg_write(port, HAL_REG_LAT + HAL_REG_CLR, mask); }
+static inline void hal_toggle(hal_port_t port, uint32_t mask)  { hal_reg_write(port, HAL_REG_LAT + HAL_REG_INV, mask); }
+
+static inline void hal_write(hal_port_t port, uint32_t mask, int value)
+{
+    if (value)
+        hal_set(port, mask);
+    else
+        hal_clr(port, mask);
+}
+
+static inline int hal_read(hal_port_t port, uint32_t mask)
+{
+    return (hal_reg_read(port, HAL_REG_PORT) & mask) != 0;
+}
+
+static inline int hal_latch(hal_port_t port, uint32_t mask)
+{
+    return (hal_reg_read(port, HAL_REG_LAT) & mask) != 0;
+}
+
+// === Peripherals (hal_pic32.c / hal_sim.c) ===
+void hal_interrupts_enable(void);
+
+void hal_timer5_init(unsigned int prescale_bits, unsigned int period, unsigned int priority);
+void hal_timer5_ack(void);
+
+// Timer3 as a pure event source (interrupt disabled) for DMA start requests
+void hal_timer3_event_init(unsigned int prescale_bits, unsigned int period);
+void hal_timer4_event_init(unsigned int prescale_bits, unsigned int period);   // same, for hal_dma_pmp()
+
+// DMA channel 0..3: each Timer3 event copies the next word of src[0..words-1]
+// into a port register (e.g. HAL_REG_LAT + HAL_REG_INV), wrapping forever.
+// hal_dma_stop() aborts, so the next hal_dma_cyclic() starts at src[0].
+void hal_dma_cyclic(int channel, const volatile uint32_t *src, int words, hal_port_t port, int reg);
+void hal_dma_stop(int channel);
+
+// Change notification: one shared vector, per-port enable and flag
+void hal_cn_init(unsigned int priority);
+void hal_cn_enable(hal_port_t port, uint32_t mask);
+void hal_cn_irq(hal_port_t port, int on);
+void hal_cn_ack(hal_port_t port);    // re-arm the mismatch latch and clear the flag
+int hal_cn_flagged(hal_port_t port); // the port has a change pending
+
+// Buzzer tone: OC1 PWM on Timer2, routed to RB14. hz = 0 or duty 0 is silence,
+// duty_pct 50 is the loudest square wave.
+void hal_tone_init(void);
+void hal_tone(unsigned int hz, unsigned int duty_pct);
+
+// RGB LED: OC3 (red, RD2), OC5 (green, RD12) and OC4 (blue, RD3) in PWM mode
+// on Timer3, so hal_timer3_event_init() must run first. Duty is 0..HAL_RGB_MAX
+// of the Timer3 period (250 us); 0 keeps the pin low.
+#define HAL_RGB_MAX 0xFFFF
+void hal_rgb_init(void);
+void hal_rgb(unsigned int r, unsigned int g, unsigned int b);
+
+// ADC: every Timer3 event converts one channel. The results fill one 8-word
+// buffer half while the ADC interrupt reads the other.
+#define HAL_ADC_BURST 8
+void hal_adc_stream(unsigned char channel, unsigned int priority);
+void hal_adc_burst(unsigned int out[HAL_ADC_BURST]);   // the completed half
+void hal_adc_ack(void);
+
+// UART4 to the USB-UART bridge, transmit only (U4TX = RF12 via PPS), 8N1.
+// hal_uart_put() queues one byte in the 8-deep TX FIFO or returns 0 if full.
+// hal_dma_uart() sends a block through a DMA channel paced by the UART's TX
+// interrupt request; the channel is busy until the last byte is in the FIFO.
+void hal_uart_init(uint32_t baud);
+int hal_uart_put(unsigned char c);
+void hal_dma_uart(int channel, const void *src, int bytes);
+int hal_dma_busy(int channel);
+
+// Parallel Master Port in master mode 1, wired to the LCD: PMA0 = RS (RB15),
+// PMRD/PMWR = R/W (RD5), PMENB = E (RD4), PMD0..7 = RE0..7. Each access is one
+// hardware bus cycle, and the port turns the data pins around for reads.
+// Times are rounded up to PBCLK wait states and clamped at the field maxima.
+void hal_pmp_init(unsigned int setup_ns, unsigned int strobe_ns, unsigned int hold_ns);
+void hal_pmp_write(unsigned int addr, unsigned char value);   // once the previous cycle ends
+unsigned char hal_pmp_read(unsigned int addr);
+// One-shot block to the PMP at addr, one byte per Timer4 event
+void hal_dma_pmp(int channel, unsigned int addr, const void *src, int bytes);
+
+// Data flash: HAL_NVM_PAGES erase pages reserved in program flash, addressed
+// by word index. Programming only clears bits; erase sets a page to all ones.
+// The CPU stalls while an operation runs (~20 us per word, ~20 ms per erase).
+#define HAL_NVM_PAGE_WORDS 1024   // 4 KB erase page
+#define HAL_NVM_PAGES      4
+uint32_t hal_nvm_read(unsigned int word);
+int hal_nvm_program(unsigned int word, uint32_t value);   // 0 on a write error
+int hal_nvm_erase(unsigned int page);
+
+#endif
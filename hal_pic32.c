@@ -0,0 +1,463 @@
+// PIC32MX370 backend for hal.h (XC32 builds only)
+#ifndef HAL_SIM
+
+#include <sys/kmem.h>
+#include "hal.h"
+
+void hal_interrupts_enable(void)
+{
+    INTCONbits.MVEC = 1;
+    asm("ei");
+}
+
+// === Timer5 ===
+void hal_timer5_init(unsigned int prescale_bits, unsigned int period, unsigned int priority)
+{
+    T5CONbits.ON = 0;
+    T5CONbits.TGATE = 0;
+    T5CONbits.TCS = 0;
+    T5CONbits.TCKPS = prescale_bits;
+
+    TMR5 = 0;
+    PR5 = period;
+
+    IPC5bits.T5IP = priority;
+    IPC5bits.T5IS = 0;
+    IFS0bits.T5IF = 0;
+    IEC0bits.T5IE = 1;
+
+    T5CONbits.ON = 1;
+}
+
+void hal_timer5_ack(void)
+{
+    IFS0bits.T5IF = 0;
+}
+
+// === Timer3 (DMA trigger only) ===
+void hal_timer3_event_init(unsigned int prescale_bits, unsigned int period)
+{
+    T3CON = 0;
+    T3CONbits.TCKPS = prescale_bits;
+    TMR3 = 0;
+    PR3 = period;
+    IEC0bits.T3IE = 0;     // no CPU interrupt, the IRQ only starts DMA cells
+    IFS0bits.T3IF = 0;
+    T3CONbits.ON = 1;
+}
+
+void hal_timer4_event_init(unsigned int prescale_bits, unsigned int period)
+{
+    T4CON = 0;
+    T4CONbits.TCKPS = prescale_bits;
+    TMR4 = 0;
+    PR4 = period;
+    IEC0bits.T4IE = 0;
+    IFS0bits.T4IF = 0;
+    T4CONbits.ON = 1;
+}
+
+// === DMA ===
+#define DMA_CYCLIC(n, src, words, dst)                  \
+    do {                                                \
+        DCH##n##CON = 0;                                \
+        DCH##n##CONbits.CHPRI = 3;                      \
+        DCH##n##CONbits.CHAEN = 1;                      \
+        DCH##n##ECON = 0;                               \
+        DCH##n##ECONbits.CHSIRQ = _TIMER_3_IRQ;         \
+        DCH##n##ECONbits.SIRQEN = 1;                    \
+        DCH##n##SSA = KVA_TO_PA(src);                   \
+        DCH##n##DSA = KVA_TO_PA(dst);                   \
+        DCH##n##SSIZ = (words) * 4;                     \
+        DCH##n##DSIZ = 4;                               \
+        DCH##n##CSIZ = 4;                               \
+        DCH##n##INTCLR = 0x00FF00FF;                    \
+        DCH##n##CONbits.CHEN = 1;                       \
+    } while (0)
+
+#define DMA_ABORT(n)                                    \
+    do {                                                \
+        DCH##n##ECONbits.CABORT = 1;                    \
+        while (DCH##n##ECONbits.CABORT);                \
+        DCH##n##CONbits.CHEN = 0;                       \
+    } while (0)
+
+void hal_dma_cyclic(int channel, const volatile uint32_t *src, int words, hal_port_t port, int reg)
+{
+    volatile uint32_t *dst = &HAL_SFR(port, reg);
+
+    DMACONbits.ON = 1;
+    switch (channel) {
+        case 0: DMA_CYCLIC(0, src, words, dst); break;
+        case 1: DMA_CYCLIC(1, src, words, dst); break;
+        case 2: DMA_CYCLIC(2, src, words, dst); break;
+        case 3: DMA_CYCLIC(3, src, words, dst); break;
+    }
+}
+
+void hal_dma_stop(int channel)
+{
+    switch (channel) {
+        case 0: DMA_ABORT(0); break;
+        case 1: DMA_ABORT(1); break;
+        case 2: DMA_ABORT(2); break;
+        case 3: DMA_ABORT(3); break;
+    }
+}
+
+// === Change notification ===
+void hal_cn_init(unsigned int priority)
+{
+    IPC8bits.CNIP = priority;
+    IPC8bits.CNIS = 0;
+}
+
+void hal_cn_enable(hal_port_t port, uint32_t mask)
+{
+    HAL_SFR(port, HAL_REG_CNCON + HAL_REG_SET) = 1u << 15;   // ON
+    HAL_SFR(port, HAL_REG_CNEN + HAL_REG_SET) = mask;
+    (void)HAL_SFR(port, HAL_REG_PORT);
+}
+
+void hal_cn_irq(hal_port_t port, int on)
+{
+    switch (port) {
+        case HAL_PORT_A: IEC1bits.CNAIE = on; break;
+        case HAL_PORT_B: IEC1bits.CNBIE = on; break;
+        case HAL_PORT_C: IEC1bits.CNCIE = on; break;
+        case HAL_PORT_D: IEC1bits.CNDIE = on; break;
+        case HAL_PORT_E: IEC1bits.CNEIE = on; break;
+        case HAL_PORT_F: IEC1bits.CNFIE = on; break;
+        case HAL_PORT_G: IEC1bits.CNGIE = on; break;
+        default: break;
+    }
+}
+
+void hal_cn_ack(hal_port_t port)
+{
+    (void)HAL_SFR(port, HAL_REG_PORT);
+    switch (port) {
+        case HAL_PORT_A: IFS1bits.CNAIF = 0; break;
+        case HAL_PORT_B: IFS1bits.CNBIF = 0; break;
+        case HAL_PORT_C: IFS1bits.CNCIF = 0; break;
+        case HAL_PORT_D: IFS1bits.CNDIF = 0; break;
+        case HAL_PORT_E: IFS1bits.CNEIF = 0; break;
+        case HAL_PORT_F: IFS1bits.CNFIF = 0; break;
+        case HAL_PORT_G: IFS1bits.CNGIF = 0; break;
+        default: break;
+    }
+}
+
+int hal_cn_flagged(hal_port_t port)
+{
+    switch (port) {
+        case HAL_PORT_A: return IFS1bits.CNAIF;
+        case HAL_PORT_B: return IFS1bits.CNBIF;
+        case HAL_PORT_C: return IFS1bits.CNCIF;
+        case HAL_PORT_D: return IFS1bits.CNDIF;
+        case HAL_PORT_E: return IFS1bits.CNEIF;
+        case HAL_PORT_F: return IFS1bits.CNFIF;
+        case HAL_PORT_G: return IFS1bits.CNGIF;
+        default: return 0;
+    }
+}
+
+// === Tone (OC1 PWM, Timer2 time base) ===
+#define TONE_TCKPS 3   // 1:8 -> 10 MHz, 16-bit period reaches down to ~153 Hz
+
+void hal_tone_init(void)
+{
+    T2CON = 0;
+    T2CONbits.TCKPS = TONE_TCKPS;
+    TMR2 = 0;
+    PR2 = 0xFFFF;
+
+    OC1CON = 0;
+    OC1CONbits.OCTSEL = 0;    // Timer2
+    OC1R = 0;
+    OC1RS = 0;
+    OC1CONbits.OCM = 6;       // PWM, fault pin disabled
+    RPB14R = 0x0C;            // PPS: OC1 drives RB14
+
+    T2CONbits.ON = 1;
+    OC1CONbits.ON = 1;
+}
+
+void hal_tone(unsigned int hz, unsigned int duty_pct)
+{
+    uint32_t period;
+
+    if (hz == 0 || duty_pct == 0) {
+        OC1RS = 0;            // output stays low from the next period on
+        return;
+    }
+    period = HAL_PBCLK_HZ / (1u << TONE_TCKPS) / hz;
+    if (period > 0x10000)
+        period = 0x10000;
+    OC1RS = period * duty_pct / 100;
+    PR2 = period - 1;
+    TMR2 = 0;
+}
+
+// === RGB LED (OC3/OC4/OC5 PWM, Timer3 time base) ===
+void hal_rgb_init(void)
+{
+    OC3CON = 0;
+    OC4CON = 0;
+    OC5CON = 0;
+    OC3R = OC3RS = 0;
+    OC4R = OC4RS = 0;
+    OC5R = OC5RS = 0;
+    OC3CONbits.OCTSEL = 1;    // Timer3, shared with the ADC / DMA events
+    OC4CONbits.OCTSEL = 1;
+    OC5CONbits.OCTSEL = 1;
+    OC3CONbits.OCM = 6;       // PWM, fault pin disabled
+    OC4CONbits.OCM = 6;
+    OC5CONbits.OCM = 6;
+    RPD2R = 0x0B;             // PPS: OC3 drives RD2 (red)
+    RPD12R = 0x0B;            // OC5 drives RD12 (green)
+    RPD3R = 0x0B;             // OC4 drives RD3 (blue)
+
+    OC3CONbits.ON = 1;
+    OC4CONbits.ON = 1;
+    OC5CONbits.ON = 1;
+}
+
+// Takes effect at the next period; full scale sets OCxRS past PR3 (always high)
+void hal_rgb(unsigned int r, unsigned int g, unsigned int b)
+{
+    uint32_t steps = PR3 + 1;
+
+    OC3RS = (r * steps + HAL_RGB_MAX) >> 16;
+    OC5RS = (g * steps + HAL_RGB_MAX) >> 16;
+    OC4RS = (b * steps + HAL_RGB_MAX) >> 16;
+}
+
+// === ADC ===
+void hal_adc_stream(unsigned char channel, unsigned int priority)
+{
+    AD1CON1 = 0;
+    AD1CON1bits.FORM = 0;       // 10-bit integer
+    AD1CON1bits.SSRC = 2;       // Timer3 period match ends sampling and converts
+    AD1CON1bits.ASAM = 1;       // sampling restarts after each conversion
+    AD1CSSL = 0;
+    AD1CON3 = 0x0002;
+    AD1CON2 = 0;
+    AD1CON2bits.VCFG = 0;
+    AD1CON2bits.SMPI = HAL_ADC_BURST - 1;
+    AD1CON2bits.BUFM = 1;       // ADC1BUF0..7 / ADC1BUF8..F ping-pong
+    AD1CHS = channel << 16;
+
+    IPC5bits.AD1IP = priority;
+    IPC5bits.AD1IS = 0;
+    IFS0bits.AD1IF = 0;
+    IEC0bits.AD1IE = 1;
+
+    AD1CON1bits.ON = 1;
+}
+
+void hal_adc_burst(unsigned int out[HAL_ADC_BURST])
+{
+    // ADC1BUFx are 0x10 apart; BUFS = 1 means the ADC is filling the upper half
+    const volatile uint32_t *buf = &ADC1BUF0 + (AD1CON2bits.BUFS ? 0 : HAL_ADC_BURST * 4);
+    int i;
+
+    for (i = 0; i < HAL_ADC_BURST; i++)
+        out[i] = buf[i * 4];
+}
+
+void hal_adc_ack(void)
+{
+    IFS0bits.AD1IF = 0;
+}
+
+// === UART4 ===
+void hal_uart_init(uint32_t baud)
+{
+    U4MODE = 0;
+    U4STA = 0;
+    U4MODEbits.BRGH = 1;                          // 4 clocks per bit
+    U4BRG = (HAL_PBCLK_HZ + 2 * baud) / (4 * baud) - 1;
+    U4MODEbits.PDSEL = 0;                         // 8N1
+    U4MODEbits.STSEL = 0;
+    U4STAbits.UTXISEL = 0;                        // TX request while the FIFO has room
+    hal_output(PIN_UART_TX);
+    RPF12R = 0x02;                                // PPS: U4TX drives RF12
+    U4MODEbits.ON = 1;
+    U4STAbits.UTXEN = 1;
+}
+
+int hal_uart_put(unsigned char c)
+{
+    if (U4STAbits.UTXBF)
+        return 0;
+    U4TXREG = c;
+    return 1;
+}
+
+#define DMA_UART(n, src, bytes)                         \
+    do {                                                \
+        DCH##n##CON = 0;                                \
+        DCH##n##CONbits.CHPRI = 1;                      \
+        DCH##n##ECON = 0;                               \
+        DCH##n##ECONbits.CHSIRQ = _UART4_TX_IRQ;        \
+        DCH##n##ECONbits.SIRQEN = 1;                    \
+        DCH##n##SSA = KVA_TO_PA(src);                   \
+        DCH##n##DSA = KVA_TO_PA(&U4TXREG);              \
+        DCH##n##SSIZ = (bytes);                         \
+        DCH##n##DSIZ = 1;                               \
+        DCH##n##CSIZ = 1;                               \
+        DCH##n##INTCLR = 0x00FF00FF;                    \
+        DCH##n##CONbits.CHEN = 1;                       \
+    } while (0)
+
+void hal_dma_uart(int channel, const void *src, int bytes)
+{
+    DMACONbits.ON = 1;
+    switch (channel) {
+        case 0: DMA_UART(0, src, bytes); break;
+        case 1: DMA_UART(1, src, bytes); break;
+        case 2: DMA_UART(2, src, bytes); break;
+        case 3: DMA_UART(3, src, bytes); break;
+    }
+}
+
+// Without CHAEN the channel turns itself off after the block
+int hal_dma_busy(int channel)
+{
+    switch (channel) {
+        case 0: return DCH0CONbits.CHEN;
+        case 1: return DCH1CONbits.CHEN;
+        case 2: return DCH2CONbits.CHEN;
+        case 3: return DCH3CONbits.CHEN;
+    }
+    return 0;
+}
+
+// === Parallel master port ===
+// n + 1 PBCLK cycles for a field value of n
+static unsigned int pmp_wait(unsigned int ns, unsigned int max)
+{
+    unsigned int cycles = (ns * (HAL_PBCLK_HZ / 1000000) + 999) / 1000;
+
+    if (cycles > max + 1)
+        return max;
+    return cycles ? cycles - 1 : 0;
+}
+
+void hal_pmp_init(unsigned int setup_ns, unsigned int strobe_ns, unsigned int hold_ns)
+{
+    PMCON = 0;
+    PMMODE = 0;
+    PMMODEbits.MODE = 3;          // master mode 1: PMRD/PMWR + PMENB
+    PMMODEbits.MODE16 = 0;
+    PMMODEbits.INCM = 0;
+    PMMODEbits.WAITB = pmp_wait(setup_ns, 3);
+    PMMODEbits.WAITM = pmp_wait(strobe_ns, 15);
+    PMMODEbits.WAITE = pmp_wait(hold_ns, 3);
+    PMAEN = 1;                    // PMA0 on RB15
+    PMCONbits.PTRDEN = 1;         // RD5 carries R/W
+    PMCONbits.PTWREN = 1;         // RD4 carries the enable strobe
+    PMCONbits.WRSP = 1;           // enable active high
+    PMCONbits.RDSP = 1;           // R/W high = read
+    PMCONbits.ON = 1;
+}
+
+void hal_pmp_write(unsigned int addr, unsigned char value)
+{
+    while (PMMODEbits.BUSY)
+        ;
+    PMADDR = addr;
+    PMDIN = value;                // starts the write cycle
+}
+
+// Reading PMDIN returns the previous read cycle's data and starts the next
+// one, so a read takes two cycles
+unsigned char hal_pmp_read(unsigned int addr)
+{
+    while (PMMODEbits.BUSY)
+        ;
+    PMADDR = addr;
+    (void)PMDIN;
+    while (PMMODEbits.BUSY)
+        ;
+    return (unsigned char)PMDIN;
+}
+
+#define DMA_PMP(n, src, bytes)                          \
+    do {                                                \
+        DCH##n##CON = 0;                                \
+        DCH##n##CONbits.CHPRI = 2;                      \
+        DCH##n##ECON = 0;                               \
+        DCH##n##ECONbits.CHSIRQ = _TIMER_4_IRQ;         \
+        DCH##n##ECONbits.SIRQEN = 1;                    \
+        DCH##n##SSA = KVA_TO_PA(src);                   \
+        DCH##n##DSA = KVA_TO_PA(&PMDIN);                \
+        DCH##n##SSIZ = (bytes);                         \
+        DCH##n##DSIZ = 1;                               \
+        DCH##n##CSIZ = 1;                               \
+        DCH##n##INTCLR = 0x00FF00FF;                    \
+        DCH##n##CONbits.CHEN = 1;                       \
+    } while (0)
+
+void hal_dma_pmp(int channel, unsigned int addr, const void *src, int bytes)
+{
+    while (PMMODEbits.BUSY)
+        ;
+    PMADDR = addr;
+    DMACONbits.ON = 1;
+    switch (channel) {
+        case 0: DMA_PMP(0, src, bytes); break;
+        case 1: DMA_PMP(1, src, bytes); break;
+        case 2: DMA_PMP(2, src, bytes); break;
+        case 3: DMA_PMP(3, src, bytes); break;
+    }
+}
+
+// === NVM ===
+// Reserved in program flash, aligned to an erase page. The programmer writes
+// it erased, so stored data survives resets but not reflashing.
+static const uint32_t __attribute__((aligned(HAL_NVM_PAGE_WORDS * 4)))
+    nvm_area[HAL_NVM_PAGES * HAL_NVM_PAGE_WORDS] = { [0 ... HAL_NVM_PAGES * HAL_NVM_PAGE_WORDS - 1] = 0xFFFFFFFF };
+
+#define NVMOP_WORD  0x1
+#define NVMOP_ERASE 0x4
+#define NVM_WR      (1u << 15)
+#define NVM_WREN    (1u << 14)
+#define NVM_ERRORS  (3u << 12)   // WRERR, LVDERR
+
+static int nvm_op(uint32_t op)
+{
+    uint32_t irq = hal_irq_save();
+
+    NVMCON = NVM_WREN | op;
+    NVMKEY = 0xAA996655;
+    NVMKEY = 0x556699AA;
+    NVMCONSET = NVM_WR;
+    while (NVMCON & NVM_WR)
+        ;
+    NVMCONCLR = NVM_WREN;
+    hal_irq_restore(irq);
+    return !(NVMCON & NVM_ERRORS);
+}
+
+uint32_t hal_nvm_read(unsigned int word)
+{
+    // volatile: the compiler must not fold the erased initialiser
+    return ((const volatile uint32_t *)nvm_area)[word];
+}
+
+int hal_nvm_program(unsigned int word, uint32_t value)
+{
+    NVMADDR = KVA_TO_PA(&nvm_area[word]);
+    NVMDATA = value;
+    return nvm_op(NVMOP_WORD);
+}
+
+int hal_nvm_erase(unsigned int page)
+{
+    NVMADDR = KVA_TO_PA(&nvm_area[page * HAL_NVM_PAGE_WORDS]);
+    return nvm_op(NVMOP_ERASE);
+}
+
+#endif
@@ -0,0 +1,1066 @@
+// Linux register simulator backend for hal.h (build with -DHAL_SIM).
+// Models the GPIO register file with CLR/SET/INV aliases, an HD44780 panel on
+// RB15/RD5/RD4/PORTE with busy-flag timing, the 4x4 keypad matrix, SW0-SW3,
+// the ADC and the Timer5 tick. Time only advances through HAL accesses, each
+// costing SIM_SFR_CYCLES of SYSCLK.
+#ifdef HAL_SIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal.h"
+#include "hal_sim.h"
+#include "nvm_sim.h"
+
+#define SIM_SFR_CYCLES   4
+#define SIM_US(us)       ((uint64_t)(us) * (HAL_SYSCLK_HZ / 1000000))
+#define LCD_EXEC_LONG    SIM_US(1520)  // clear / return home
+#define LCD_EXEC_SHORT   SIM_US(37)
+#define LCD_EXEC_DATA    SIM_US(41)
+#define NVM_WORD_CYCLES  SIM_US(20)
+#define NVM_ERASE_CYCLES SIM_US(20000)
+
+void Timer5ISR(void);
+void ChangeNoticeISR(void);
+void ADCISR(void);
+
+static uint32_t regs[HAL_PORT_COUNT][64];
+static uint64_t now;
+static struct sim_stats stats;
+
+static int ints_enabled;
+static unsigned int in_isr;   // priority of the running ISR, 0 in main()
+
+static struct {
+    uint32_t latch[HAL_PORT_COUNT];
+    int flag[HAL_PORT_COUNT];
+    int irq[HAL_PORT_COUNT];
+    unsigned int priority;
+} cn;
+
+static struct {
+    int enabled;
+    uint64_t period;
+    uint64_t next;
+    unsigned int priority;
+} t5;
+
+static struct {
+    int enabled;
+    uint64_t period;
+    uint64_t next;
+} t3, t4;
+
+static struct {
+    int enabled;
+    const volatile uint32_t *src;
+    int words;
+    int pos;
+    hal_port_t port;
+    int reg;
+} dma[4];
+static int dma_held;            // sim_dma_hold(): Timer3 events leave the cyclic channels alone
+
+static struct {
+    int enabled;
+    unsigned int hz;
+    uint64_t since;
+} tone;
+
+// RGB LED PWM duties, 0..HAL_RGB_MAX
+static struct {
+    int enabled;
+    unsigned int duty[3];
+    uint64_t since;             // lit since, while any duty is non-zero
+} rgb;
+
+// PMP master mode 1 on the LCD pins; one-shot DMA blocks paced by Timer4
+static struct {
+    int enabled;
+    uint64_t cycle;             // SYSCLK cycles per bus cycle
+    uint64_t busy_until;
+    int dma_channel;
+    unsigned int dma_addr;
+    const unsigned char *dma_src;
+    int dma_left;
+} pmp;
+
+static struct {
+    unsigned int value[32];
+    unsigned int noise[32];     // +/- LSB of uniform noise per conversion
+    uint32_t seed;
+    int stream;
+    int channel;
+    unsigned int buf[2 * HAL_ADC_BURST];
+    int pos;
+    int flag;
+    unsigned int priority;
+} adc;
+
+// UART4 line model: bytes leave at the baud rate, the shift register and the
+// 8-deep FIFO hold at most 9. Output goes to $SIM_UART (a file or a pty).
+static struct {
+    int enabled;
+    uint64_t byte_cycles;
+    uint64_t free_at;         // when the last queued byte has left the wire
+    uint64_t dma_until;       // one-shot DMA block still feeding the FIFO
+    FILE *out;
+} uart;
+
+static struct {
+    unsigned char ddram[128];
+    unsigned char cgram[64];
+    unsigned char ac;
+    int cg_mode;
+    int unplugged;              // sim_lcd_connect(0): writes lost, DB7 floats high
+    int increment;
+    uint64_t busy_until;
+} lcd;
+
+static char ssd_shown[5] = "    ";  // last pattern seen on each digit, AN3..AN0
+
+static unsigned char keys[5][5];   // [row][col], 1-based like scan_keypad
+static int switches[4];
+
+static struct {
+    uint64_t at;
+    char op[8];
+    int a, b, c;
+} script[1024];
+static int script_len;
+static int script_pos;
+static uint64_t end_at;
+static int initialised;
+
+static void sim_init(void);
+
+// === Register file ===
+static uint32_t lcd_bus_out(void)
+{
+    // Status read: RS = 0, RW = 1 -> busy flag on DB7, address counter on DB6..0
+    if (!(regs[HAL_PORT_D][HAL_REG_LAT] & (1u << 5)))
+        return 0xFF;
+    if ((regs[HAL_PORT_B][HAL_REG_LAT] & (1u << 15)) || lcd.unplugged)
+        return 0xFF;
+    return (now < lcd.busy_until ? 0x80 : 0x00) | (lcd.ac & 0x7F);
+}
+
+static int key_row_driven(int row)
+{
+    static const struct { hal_port_t port; uint32_t mask; } rows[5] = {
+        { HAL_PORT_A, 0 }, { PIN_KEY_ROW1 }, { PIN_KEY_ROW2 }, { PIN_KEY_ROW3 }, { PIN_KEY_ROW4 }
+    };
+    uint32_t tris = regs[rows[row].port][HAL_REG_TRIS];
+    uint32_t lat = regs[rows[row].port][HAL_REG_LAT];
+    return !(tris & rows[row].mask) && !(lat & rows[row].mask);
+}
+
+static uint32_t port_inputs(hal_port_t port)
+{
+    // Undriven inputs float high through the pull-ups on the Basys MX3
+    uint32_t level = 0xFFFFFFFF;
+    int row, col;
+
+    for (row = 1; row <= 4; row++) {
+        if (!key_row_driven(row))
+            continue;
+        for (col = 1; col <= 4; col++) {
+            if (!keys[row][col])
+                continue;
+            if (col == 1 && port == HAL_PORT_C) level &= ~(1u << 3);
+            if (col == 2 && port == HAL_PORT_G) level &= ~(1u << 7);
+            if (col == 3 && port == HAL_PORT_G) level &= ~(1u << 8);
+            if (col == 4 && port == HAL_PORT_G) level &= ~(1u << 9);
+        }
+    }
+
+    if (port == HAL_PORT_F) {
+        level &= ~((1u << 3) | (1u << 5) | (1u << 4));
+        level |= (switches[0] ? 1u << 3 : 0) | (switches[1] ? 1u << 5 : 0) | (switches[2] ? 1u << 4 : 0);
+    }
+    if (port == HAL_PORT_D) {
+        level &= ~(1u << 15);
+        level |= switches[3] ? 1u << 15 : 0;
+    }
+    if (port == HAL_PORT_E)
+        level = (level & ~0xFFu) | lcd_bus_out();
+
+    return level;
+}
+
+static void lcd_ac_step(void)
+{
+    if (lcd.cg_mode) {
+        lcd.ac = (lcd.ac + (lcd.increment ? 1 : -1)) & 0x3F;
+        return;
+    }
+    lcd.ac += lcd.increment ? 1 : -1;
+    if (lcd.ac == 0x28) lcd.ac = 0x40;
+    else if (lcd.ac == 0x68) lcd.ac = 0x00;
+    else if (lcd.ac == 0x3F) lcd.ac = 0x27;
+    else if (lcd.ac == 0xFF) lcd.ac = 0x67;
+}
+
+// One write cycle as the panel latches it, from the pins or the PMP
+static void lcd_latch(int rs, unsigned char value)
+{
+    if (lcd.unplugged)
+        return;
+    if (now < lcd.busy_until)
+        stats.lcd_violations++;
+
+    if (rs) {
+        stats.lcd_data++;
+        if (lcd.cg_mode)
+            lcd.cgram[lcd.ac & 0x3F] = value;
+        else
+            lcd.ddram[lcd.ac & 0x7F] = value;
+        lcd_ac_step();
+        lcd.busy_until = now + LCD_EXEC_DATA;
+        return;
+    }
+
+    stats.lcd_commands++;
+    lcd.busy_until = now + LCD_EXEC_SHORT;
+    if (value & 0x80) {
+        lcd.ac = value & 0x7F;
+        lcd.cg_mode = 0;
+    } else if (value & 0x40) {
+        lcd.ac = value & 0x3F;
+        lcd.cg_mode = 1;
+    } else if ((value & 0xFC) == 0x04) {
+        lcd.increment = (value & 0x02) != 0;
+    } else if ((value & 0xFE) == 0x02) {
+        lcd.ac = 0;
+        lcd.cg_mode = 0;
+        lcd.busy_until = now + LCD_EXEC_LONG;
+    } else if (value == 0x01) {
+        memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+        lcd.ac = 0;
+        lcd.cg_mode = 0;
+        lcd.increment = 1;
+        lcd.busy_until = now + LCD_EXEC_LONG;
+    }
+}
+
+static void lcd_strobe(void)
+{
+    if (regs[HAL_PORT_D][HAL_REG_LAT] & (1u << 5))
+        return;   // read cycle, handled by lcd_bus_out()
+    lcd_latch((regs[HAL_PORT_B][HAL_REG_LAT] & (1u << 15)) != 0, regs[HAL_PORT_E][HAL_REG_LAT] & 0xFF);
+}
+
+static uint32_t port_value(hal_port_t port)
+{
+    uint32_t tris = regs[port][HAL_REG_TRIS];
+
+    return (regs[port][HAL_REG_LAT] & ~tris) | (port_inputs(port) & tris);
+}
+
+// Change notification: flag a port whose enabled pins no longer match the
+// levels seen by the last PORTx read
+static void cn_scan(void)
+{
+    for (int p = 0; p < HAL_PORT_COUNT; p++) {
+        uint32_t diff;
+
+        if (!(regs[p][HAL_REG_CNCON] & (1u << 15)) || !regs[p][HAL_REG_CNEN])
+            continue;
+        diff = (port_value((hal_port_t)p) ^ cn.latch[p]) & regs[p][HAL_REG_CNEN];
+        if (diff) {
+            regs[p][HAL_REG_CNSTAT] |= diff;
+            cn.flag[p] = 1;
+        }
+    }
+}
+
+uint32_t hal_reg_read(hal_port_t port, int reg)
+{
+    uint32_t value;
+
+    sim_init();
+    stats.sfr_accesses++;
+    sim_advance(SIM_SFR_CYCLES);
+
+    value = regs[port][reg & ~3];
+    if ((reg & ~3) == HAL_REG_PORT) {
+        value = port_value(port);
+        cn.latch[port] = value;
+        regs[port][HAL_REG_CNSTAT] = 0;
+        if (port == HAL_PORT_E && (regs[HAL_PORT_D][HAL_REG_LAT] & (1u << 5)) &&
+            !(regs[HAL_PORT_B][HAL_REG_LAT] & (1u << 15)))
+            stats.lcd_status_reads++;
+    }
+    return value;
+}
+
+static void reg_apply(hal_port_t port, int reg, uint32_t value)
+{
+    int base = reg & ~3;
+    uint32_t old, *r;
+
+    // Writes to PORTx land in LATx, as on the part
+    if (base == HAL_REG_PORT)
+        base = HAL_REG_LAT;
+    r = &regs[port][base];
+    old = *r;
+
+    switch (reg & 3) {
+        case 0:            *r = value;  break;
+        case HAL_REG_CLR:  *r &= ~value; break;
+        case HAL_REG_SET:  *r |= value;  break;
+        case HAL_REG_INV:  *r ^= value;  break;
+    }
+
+    // EN falling edge latches the bus into the panel
+    if (port == HAL_PORT_D && base == HAL_REG_LAT && (old & (1u << 4)) && !(*r & (1u << 4)))
+        lcd_strobe();
+    if (base == HAL_REG_LAT || base == HAL_REG_TRIS)
+        cn_scan();
+}
+
+void hal_reg_write(hal_port_t port, int reg, uint32_t value)
+{
+    sim_init();
+    stats.sfr_accesses++;
+    sim_advance(SIM_SFR_CYCLES);
+    reg_apply(port, reg, value);
+}
+
+void hal_nop(void)
+{
+    sim_advance(1);
+}
+
+uint32_t hal_core_timer(void)
+{
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES);
+    return (uint32_t)(now / 2);
+}
+
+// Jump to the next Timer5 tick, which is where the ISRs wake the core
+void hal_idle(void)
+{
+    uint64_t until = now + SIM_SFR_CYCLES;
+
+    sim_init();
+    if (t5.enabled && ints_enabled && t5.next > until)
+        until = t5.next;
+    stats.idle_waits++;
+    stats.idle_cycles += until - now;
+    sim_advance((uint32_t)(until - now));
+}
+
+// ISRs only run from sim_advance(), so masking is just the enable flag
+uint32_t hal_irq_save(void)
+{
+    uint32_t state = (uint32_t)ints_enabled;
+
+    ints_enabled = 0;
+    return state;
+}
+
+void hal_irq_restore(uint32_t state)
+{
+    ints_enabled = (int)state;
+}
+
+unsigned int hal_irq_level(void)
+{
+    return in_isr;
+}
+
+// === Peripherals ===
+void hal_interrupts_enable(void)
+{
+    sim_init();
+    ints_enabled = 1;
+}
+
+static uint64_t timer_period(unsigned int prescale_bits, unsigned int period)
+{
+    static const unsigned int prescale[8] = { 1, 2, 4, 8, 16, 32, 64, 256 };
+
+    return (uint64_t)(period + 1) * prescale[prescale_bits & 7];
+}
+
+void hal_timer5_init(unsigned int prescale_bits, unsigned int period, unsigned int priority)
+{
+    sim_init();
+    t5.priority = priority;
+    t5.period = timer_period(prescale_bits, period);
+    t5.next = now + t5.period;
+    t5.enabled = 1;
+}
+
+void hal_timer3_event_init(unsigned int prescale_bits, unsigned int period)
+{
+    sim_init();
+    t3.period = timer_period(prescale_bits, period);
+    t3.next = now + t3.period;
+    t3.enabled = 1;
+}
+
+void hal_timer4_event_init(unsigned int prescale_bits, unsigned int period)
+{
+    sim_init();
+    t4.period = timer_period(prescale_bits, period);
+    t4.next = now + t4.period;
+    t4.enabled = 1;
+}
+
+void hal_dma_cyclic(int channel, const volatile uint32_t *src, int words, hal_port_t port, int reg)
+{
+    sim_advance(SIM_SFR_CYCLES * 8);
+    dma[channel].src = src;
+    dma[channel].words = words;
+    dma[channel].pos = 0;
+    dma[channel].port = port;
+    dma[channel].reg = reg;
+    dma[channel].enabled = 1;
+}
+
+void hal_dma_stop(int channel)
+{
+    sim_advance(SIM_SFR_CYCLES * 2);
+    dma[channel].enabled = 0;
+    dma[channel].pos = 0;
+}
+
+void hal_timer5_ack(void)
+{
+    sim_advance(SIM_SFR_CYCLES);
+}
+
+void hal_cn_init(unsigned int priority)
+{
+    sim_init();
+    cn.priority = priority;
+}
+
+void hal_cn_enable(hal_port_t port, uint32_t mask)
+{
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES * 3);
+    regs[port][HAL_REG_CNCON] |= 1u << 15;
+    regs[port][HAL_REG_CNEN] |= mask;
+    cn.latch[port] = port_value(port);
+}
+
+void hal_cn_irq(hal_port_t port, int on)
+{
+    sim_advance(SIM_SFR_CYCLES);
+    cn.irq[port] = on;
+}
+
+void hal_cn_ack(hal_port_t port)
+{
+    (void)hal_reg_read(port, HAL_REG_PORT);
+    sim_advance(SIM_SFR_CYCLES);
+    cn.flag[port] = 0;
+}
+
+int hal_cn_flagged(hal_port_t port)
+{
+    sim_advance(SIM_SFR_CYCLES);
+    return cn.flag[port];
+}
+
+void hal_tone_init(void)
+{
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES * 11);
+    tone.enabled = 1;
+}
+
+void hal_tone(unsigned int hz, unsigned int duty_pct)
+{
+    if (!duty_pct)
+        hz = 0;
+    sim_advance(SIM_SFR_CYCLES * 3);
+    if (!tone.enabled || hz == tone.hz)
+        return;
+    if (tone.hz)
+        stats.tone_cycles += now - tone.since;
+    if (hz)
+        stats.tone_notes++;
+    tone.hz = hz;
+    tone.since = now;
+}
+
+void hal_rgb_init(void)
+{
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES * 24);
+    rgb.enabled = 1;
+}
+
+void hal_rgb(unsigned int r, unsigned int g, unsigned int b)
+{
+    int lit = rgb.duty[0] || rgb.duty[1] || rgb.duty[2];
+
+    sim_advance(SIM_SFR_CYCLES * 4);
+    if (!rgb.enabled || (r == rgb.duty[0] && g == rgb.duty[1] && b == rgb.duty[2]))
+        return;
+    stats.rgb_updates++;
+    rgb.duty[0] = r;
+    rgb.duty[1] = g;
+    rgb.duty[2] = b;
+    if (lit && !(r || g || b))
+        stats.rgb_lit_cycles += now - rgb.since;
+    else if (!lit && (r || g || b))
+        rgb.since = now;
+}
+
+void hal_adc_stream(unsigned char channel, unsigned int priority)
+{
+    sim_init();
+    adc.priority = priority;
+    sim_advance(SIM_SFR_CYCLES * 14);
+    adc.channel = channel & 31;
+    adc.pos = 0;
+    adc.flag = 0;
+    adc.stream = 1;
+}
+
+void hal_adc_burst(unsigned int out[HAL_ADC_BURST])
+{
+    // The half the converter is not filling
+    int base = adc.pos < HAL_ADC_BURST ? HAL_ADC_BURST : 0;
+
+    sim_advance(SIM_SFR_CYCLES * (1 + HAL_ADC_BURST));
+    for (int i = 0; i < HAL_ADC_BURST; i++)
+        out[i] = adc.buf[base + i];
+}
+
+void hal_adc_ack(void)
+{
+    sim_advance(SIM_SFR_CYCLES);
+    adc.flag = 0;
+}
+
+void hal_uart_init(uint32_t baud)
+{
+    const char *path;
+
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES * 9);
+    uart.byte_cycles = (uint64_t)HAL_SYSCLK_HZ * 10 / baud;   // start + 8 data + stop
+    uart.free_at = now;
+    uart.enabled = 1;
+    path = getenv("SIM_UART");
+    if (path && !uart.out)
+        uart.out = fopen(path, "wb");
+}
+
+static void uart_send(unsigned char c)
+{
+    if (uart.free_at < now)
+        uart.free_at = now;
+    uart.free_at += uart.byte_cycles;
+    stats.uart_bytes++;
+    if (uart.out) {
+        fputc(c, uart.out);
+        fflush(uart.out);
+    }
+}
+
+int hal_uart_put(unsigned char c)
+{
+    sim_advance(SIM_SFR_CYCLES);
+    if (!uart.enabled || (uart.free_at > now && uart.free_at - now > 8 * uart.byte_cycles))
+        return 0;
+    sim_advance(SIM_SFR_CYCLES);
+    uart_send(c);
+    return 1;
+}
+
+// The block goes out at once; the channel reads busy until the last byte
+// would have entered the FIFO
+void hal_dma_uart(int channel, const void *src, int bytes)
+{
+    const unsigned char *p = src;
+
+    (void)channel;
+    sim_advance(SIM_SFR_CYCLES * 10);
+    while (bytes-- > 0)
+        uart_send(*p++);
+    uart.dma_until = uart.free_at > 9 * uart.byte_cycles ? uart.free_at - 9 * uart.byte_cycles : 0;
+    stats.uart_dma_blocks++;
+}
+
+int hal_dma_busy(int channel)
+{
+    sim_advance(SIM_SFR_CYCLES);
+    if (pmp.dma_left && channel == pmp.dma_channel)
+        return 1;
+    return now < uart.dma_until;
+}
+
+// === PMP ===
+static uint64_t pmp_wait(unsigned int ns, unsigned int max)
+{
+    uint64_t cycles = ((uint64_t)ns * (HAL_PBCLK_HZ / 1000000) + 999) / 1000;
+
+    return cycles < 1 ? 1 : cycles > max + 1 ? max + 1 : cycles;
+}
+
+void hal_pmp_init(unsigned int setup_ns, unsigned int strobe_ns, unsigned int hold_ns)
+{
+    sim_init();
+    sim_advance(SIM_SFR_CYCLES * 10);
+    pmp.cycle = (pmp_wait(setup_ns, 3) + pmp_wait(strobe_ns, 15) + pmp_wait(hold_ns, 3)) * HAL_PB_DIV;
+    pmp.busy_until = now;
+    pmp.enabled = 1;
+}
+
+static void pmp_sync(void)
+{
+    if (pmp.busy_until > now)
+        sim_advance((uint32_t)(pmp.busy_until - now));
+}
+
+void hal_pmp_write(unsigned int addr, unsigned char value)
+{
+    pmp_sync();
+    sim_advance(SIM_SFR_CYCLES * 2);
+    stats.sfr_accesses += 2;
+    lcd_latch(addr & 1, value);
+    pmp.busy_until = now + pmp.cycle;
+    stats.pmp_cycles++;
+}
+
+// Only status reads are modelled: busy flag and address counter
+unsigned char hal_pmp_read(unsigned int addr)
+{
+    unsigned char value;
+
+    pmp_sync();
+    sim_advance(SIM_SFR_CYCLES * 2);
+    pmp.busy_until = now + pmp.cycle;
+    pmp_sync();
+    value = (addr & 1) || lcd.unplugged ? 0xFF : (now < lcd.busy_until ? 0x80 : 0x00) | (lcd.ac & 0x7F);
+    sim_advance(SIM_SFR_CYCLES);
+    pmp.busy_until = now + pmp.cycle;   // the read of PMDIN starts another cycle
+    stats.sfr_accesses += 3;
+    stats.pmp_cycles += 2;
+    stats.lcd_status_reads++;
+    return value;
+}
+
+void hal_dma_pmp(int channel, unsigned int addr, const void *src, int bytes)
+{
+    pmp_sync();
+    sim_advance(SIM_SFR_CYCLES * 12);
+    pmp.dma_channel = channel;
+    pmp.dma_addr = addr;
+    pmp.dma_src = src;
+    pmp.dma_left = bytes;
+    stats.pmp_dma_blocks++;
+}
+
+// === NVM (nvm_sim.c) ===
+// Flash operations stall the core with interrupts held off: Timer5 periods
+// that elapse meanwhile collapse into one pending interrupt, like the T5IF flag
+static void nvm_stall(uint64_t cycles)
+{
+    uint32_t irq = hal_irq_save();
+
+    stats.nvm_stall_cycles += cycles;
+    sim_advance((uint32_t)cycles);
+    while (t5.enabled && t5.next + t5.period <= now) {
+        t5.next += t5.period;
+        stats.timer5_missed++;
+    }
+    hal_irq_restore(irq);
+}
+
+// SIM_NVM_CUT: the power fails in that flash operation, the image is saved
+// torn and the run ends; the next run with the same SIM_NVM has to recover
+static void nvm_check_power(void)
+{
+    if (nvm_sim_powered())
+        return;
+    printf("nvm: power cut in flash operation %lu\n", nvm_sim_ops());
+    exit(0);
+}
+
+uint32_t hal_nvm_read(unsigned int word)
+{
+    sim_init();
+    sim_advance(1);
+    return nvm_sim_read(word);
+}
+
+int hal_nvm_program(unsigned int word, uint32_t value)
+{
+    int ok;
+
+    sim_init();
+    ok = nvm_sim_program(word, value);
+    stats.nvm_programs++;
+    nvm_stall(NVM_WORD_CYCLES);
+    nvm_check_power();
+    return ok;
+}
+
+int hal_nvm_erase(unsigned int page)
+{
+    int ok;
+
+    sim_init();
+    ok = nvm_sim_erase(page);
+    stats.nvm_erases++;
+    nvm_stall(NVM_ERASE_CYCLES);
+    nvm_check_power();
+    return ok;
+}
+
+static void nvm_save(void)
+{
+    nvm_sim_save(getenv("SIM_NVM"));
+}
+
+// One conversion per Timer3 event, the interrupt fires at each half boundary
+static void adc_convert(void)
+{
+    int v = (int)adc.value[adc.channel];
+
+    if (adc.noise[adc.channel]) {
+        int span = 2 * (int)adc.noise[adc.channel] + 1;
+
+        adc.seed = adc.seed * 1103515245u + 12345u;
+        v += (int)((adc.seed >> 16) % (uint32_t)span) - (int)adc.noise[adc.channel];
+    }
+    adc.buf[adc.pos] = v < 0 ? 0 : v > 0x3FF ? 0x3FF : (unsigned int)v;
+    adc.pos = (adc.pos + 1) % (2 * HAL_ADC_BURST);
+    if (adc.pos % HAL_ADC_BURST == 0)
+        adc.flag = 1;
+}
+
+// === Time and scripting ===
+static void script_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+
+    if (!f) {
+        fprintf(stderr, "sim: cannot open %s\n", path);
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), f) && script_len < (int)(sizeof(script) / sizeof(script[0]))) {
+        unsigned long ms;
+        int n;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        n = sscanf(line, "%lu %7s %d %d %d", &ms, script[script_len].op,
+                   &script[script_len].a, &script[script_len].b, &script[script_len].c);
+        if (n < 2)
+            continue;
+        script[script_len].at = (uint64_t)ms * SIM_CYCLES_PER_MS;
+        script_len++;
+    }
+    fclose(f);
+}
+
+static void script_run(void)
+{
+    while (script_pos < script_len && script[script_pos].at <= now) {
+        const char *op = script[script_pos].op;
+        int a = script[script_pos].a, b = script[script_pos].b, c = script[script_pos].c;
+
+        if (!strcmp(op, "key"))
+            sim_key(a, b, c);
+        else if (!strcmp(op, "sw"))
+            sim_switch(a, b);
+        else if (!strcmp(op, "adc"))
+            sim_adc_set(a, (unsigned int)b);
+        else if (!strcmp(op, "noise"))
+            sim_adc_noise(a, (unsigned int)b);
+        else if (!strcmp(op, "lcd"))
+            sim_lcd_connect(a);
+        else if (!strcmp(op, "end"))
+            end_at = now;
+        script_pos++;
+    }
+}
+
+static void sim_init(void)
+{
+    const char *path, *end;
+
+    if (initialised)
+        return;
+    initialised = 1;
+
+    memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+    lcd.increment = 1;
+    for (int p = 0; p < HAL_PORT_COUNT; p++) {
+        regs[p][HAL_REG_TRIS] = 0xFFFFFFFF;   // POR: all inputs, all analog
+        regs[p][HAL_REG_ANSEL] = 0xFFFFFFFF;
+    }
+
+    end = getenv("SIM_END_MS");
+    end_at = (uint64_t)(end ? strtoul(end, NULL, 10) : 10000) * SIM_CYCLES_PER_MS;
+    path = getenv("SIM_SCRIPT");
+    if (path)
+        script_load(path);
+    atexit(sim_report);
+
+    path = getenv("SIM_NVM");
+    if (path) {
+        nvm_sim_load(path);
+        atexit(nvm_save);
+    }
+    path = getenv("SIM_NVM_CUT");
+    if (path)
+        nvm_sim_cut_after(strtol(path, NULL, 10), 0x5EED);
+}
+
+// Debug dumps (e.g. prof_dump) go to the file named by SIM_DUMP, if any
+void sim_dump_line(const char *line)
+{
+    static FILE *f;
+    static int tried;
+    const char *path;
+
+    if (!f && !tried) {
+        tried = 1;
+        path = getenv("SIM_DUMP");
+        if (path)
+            f = fopen(path, "w");
+    }
+    if (f) {
+        fputs(line, f);
+        fputc('\n', f);
+        fflush(f);
+    }
+}
+
+uint64_t sim_cycles(void)
+{
+    return now;
+}
+
+// Decode whichever seven-segment digit is lit right now
+static void ssd_sample(void)
+{
+    static const struct { hal_port_t port; uint32_t mask; } an[4] = {
+        { PIN_SSD_AN3 }, { PIN_SSD_AN2 }, { PIN_SSD_AN1 }, { PIN_SSD_AN0 }
+    }, seg[7] = {
+        { PIN_SSD_CA }, { PIN_SSD_CB }, { PIN_SSD_CC }, { PIN_SSD_CD },
+        { PIN_SSD_CE }, { PIN_SSD_CF }, { PIN_SSD_CG }
+    };
+    static const unsigned char font[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+    unsigned char pattern = 0;
+    int lit = -1, d, i;
+
+    for (d = 0; d < 4; d++) {
+        if (regs[an[d].port][HAL_REG_LAT] & an[d].mask)
+            continue;
+        if (lit >= 0)
+            return;   // two anodes at once: ghosting, ignore
+        lit = d;
+    }
+    if (lit < 0)
+        return;
+    for (i = 0; i < 7; i++)
+        if (!(regs[seg[i].port][HAL_REG_LAT] & seg[i].mask))
+            pattern |= 1 << i;
+    ssd_shown[lit] = '?';
+    for (i = 0; i < 10; i++)
+        if (font[i] == pattern)
+            ssd_shown[lit] = '0' + i;
+}
+
+// One cell on every armed cyclic channel, as a Timer3 event starts it
+static void dma_cyclic_step(void)
+{
+    for (int ch = 0; ch < 4; ch++) {
+        if (!dma[ch].enabled)
+            continue;
+        reg_apply(dma[ch].port, dma[ch].reg, dma[ch].src[dma[ch].pos]);
+        dma[ch].pos = (dma[ch].pos + 1) % dma[ch].words;
+        stats.dma_cells++;
+    }
+}
+
+// Timer3 events start one cell transfer on every armed DMA channel and trigger
+// the streaming ADC conversion
+static void dma_run(void)
+{
+    // The panel sees each PMP cell at its Timer4 event, not at the end of
+    // the span being simulated
+    while (t4.enabled && now >= t4.next) {
+        uint64_t at = now;
+
+        now = t4.next;
+        t4.next += t4.period;
+        if (pmp.dma_left) {
+            lcd_latch(pmp.dma_addr & 1, *pmp.dma_src++);
+            pmp.dma_left--;
+            pmp.busy_until = now + pmp.cycle;
+            stats.pmp_cycles++;
+            stats.dma_cells++;
+        }
+        now = at;
+    }
+    while (t3.enabled && now >= t3.next) {
+        t3.next += t3.period;
+        if (!dma_held)
+            dma_cyclic_step();
+        if (adc.stream)
+            adc_convert();
+        ssd_sample();
+    }
+}
+
+void sim_advance(uint32_t cycles)
+{
+    now += cycles;
+    dma_run();
+    if (in_isr) {
+        stats.isr_cycles += cycles;
+        return;
+    }
+
+    script_run();
+    if (now >= end_at)
+        exit(0);
+
+    for (int p = 0; p < HAL_PORT_COUNT; p++) {
+        if (ints_enabled && cn.flag[p] && cn.irq[p]) {
+            stats.cn_interrupts++;
+            in_isr = cn.priority;
+            ChangeNoticeISR();
+            in_isr = 0;
+            break;
+        }
+    }
+
+    if (ints_enabled && adc.flag) {
+        stats.adc_interrupts++;
+        in_isr = adc.priority;
+        ADCISR();
+        in_isr = 0;
+    }
+
+    while (t5.enabled && ints_enabled && now >= t5.next) {
+        uint64_t start = now, spent;
+        t5.next += t5.period;
+        stats.timer5_ticks++;
+        in_isr = t5.priority;
+        Timer5ISR();
+        in_isr = 0;
+        ssd_sample();
+        spent = now - start;
+        if (spent > stats.isr_max_cycles)
+            stats.isr_max_cycles = spent;
+    }
+}
+
+void sim_key(int row, int col, int down)
+{
+    if (row >= 1 && row <= 4 && col >= 1 && col <= 4)
+        keys[row][col] = down != 0;
+    cn_scan();
+}
+
+void sim_switch(int index, int on)
+{
+    if (index >= 0 && index < 4)
+        switches[index] = on != 0;
+    cn_scan();
+}
+
+void sim_adc_set(int channel, unsigned int value)
+{
+    if (channel >= 0 && channel < 32)
+        adc.value[channel] = value;
+}
+
+void sim_adc_noise(int channel, unsigned int lsb)
+{
+    if (channel >= 0 && channel < 32)
+        adc.noise[channel] = lsb;
+}
+
+void sim_lcd_connect(int on)
+{
+    lcd.unplugged = !on;
+}
+
+void sim_dma_hold(int on)
+{
+    dma_held = on;
+}
+
+void sim_dma_step(void)
+{
+    dma_cyclic_step();
+}
+
+uint32_t sim_latch(hal_port_t port)
+{
+    return regs[port][HAL_REG_LAT];
+}
+
+void sim_lcd_text(int row, char out[17])
+{
+    for (int i = 0; i < 16; i++) {
+        unsigned char c = lcd.ddram[(row ? 0x40 : 0x00) + i];
+        out[i] = c < 8 ? (char)('0' + c) : (c >= 0x20 && c < 0x7F ? (char)c : '?');
+    }
+    out[16] = 0;
+}
+
+const unsigned char *sim_lcd_cgram(void)
+{
+    return lcd.cgram;
+}
+
+const struct sim_stats *sim_get_stats(void)
+{
+    return &stats;
+}
+
+void sim_report(void)
+{
+    char line[17];
+
+    printf("sim: %.3f ms simulated\n", (double)now / SIM_CYCLES_PER_MS);
+    sim_lcd_text(0, line);
+    printf("lcd: [%s]\n", line);
+    sim_lcd_text(1, line);
+    printf("lcd: [%s]\n", line);
+    printf("lcd: %llu commands, %llu data, %llu status reads, %llu busy violations\n",
+           (unsigned long long)stats.lcd_commands, (unsigned long long)stats.lcd_data,
+           (unsigned long long)stats.lcd_status_reads, (unsigned long long)stats.lcd_violations);
+    printf("t5:  %llu ticks, %.1f cycles/tick avg, %llu max\n",
+           (unsigned long long)stats.timer5_ticks,
+           stats.timer5_ticks ? (double)stats.isr_cycles / stats.timer5_ticks : 0.0,
+           (unsigned long long)stats.isr_max_cycles);
+    printf("ssd: [%s]\n", ssd_shown);
+    printf("cpu: %.1f%% busy, %llu waits\n", now ? 100.0 * (double)(now - stats.idle_cycles) / (double)now : 0.0,
+           (unsigned long long)stats.idle_waits);
+    printf("cn:  %llu interrupts\n", (unsigned long long)stats.cn_interrupts);
+    printf("adc: %llu interrupts\n", (unsigned long long)stats.adc_interrupts);
+    printf("snd: %llu notes, %.1f ms audible\n", (unsigned long long)stats.tone_notes,
+           (double)(stats.tone_cycles + (tone.hz ? now - tone.since : 0)) / SIM_CYCLES_PER_MS);
+    printf("rgb: %llu duty updates, %.1f ms lit, now %u/%u/%u\n", (unsigned long long)stats.rgb_updates,
+           (double)(stats.rgb_lit_cycles + (rgb.duty[0] || rgb.duty[1] || rgb.duty[2] ? now - rgb.since : 0)) / SIM_CYCLES_PER_MS,
+           rgb.duty[0], rgb.duty[1], rgb.duty[2]);
+    printf("dma: %llu cell transfers\n", (unsigned long long)stats.dma_cells);
+    printf("pmp: %llu bus cycles, %llu DMA blocks\n", (unsigned long long)stats.pmp_cycles,
+           (unsigned long long)stats.pmp_dma_blocks);
+    printf("uart: %llu bytes, %llu DMA blocks\n", (unsigned long long)stats.uart_bytes,
+           (unsigned long long)stats.uart_dma_blocks);
+    printf("nvm: %llu programs, %llu erases, %.1f ms stalled, %llu Timer5 ticks lost\n",
+           (unsigned long long)stats.nvm_programs, (unsigned long long)stats.nvm_erases,
+           (double)stats.nvm_stall_cycles / SIM_CYCLES_PER_MS, (unsigned long long)stats.timer5_missed);
+    printf("sfr: %llu accesses\n", (unsigned long long)stats.sfr_accesses);
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+// Control and inspection API of the Linux register simulator (hal_sim.c).
+// Inputs can also be scripted through SIM_SCRIPT, see README.
+
+#include <stdint.h>
+
+#include "hal.h"
+
+#define SIM_CYCLES_PER_MS (HAL_SYSCLK_HZ / 1000)
+
+struct sim_stats {
+    uint64_t sfr_accesses;     // HAL register reads + writes
+    uint64_t lcd_commands;     // HD44780 instruction writes
+    uint64_t lcd_data;         // HD44780 data writes
+    uint64_t lcd_status_reads; // busy-flag polls seen by the panel
+    uint64_t lcd_violations;   // writes issued while the panel was still busy
+    uint64_t timer5_ticks;
+    uint64_t isr_cycles;       // cycles spent inside Timer5ISR
+    uint64_t isr_max_cycles;
+    uint64_t cn_interrupts;    // ChangeNoticeISR entries
+    uint64_t adc_interrupts;   // ADCISR entries, one per HAL_ADC_BURST conversions
+    uint64_t tone_notes;       // hal_tone() frequency changes to a non-zero pitch
+    uint64_t tone_cycles;      // time the buzzer PWM was running
+    uint64_t rgb_updates;      // RGB LED duty changes
+    uint64_t rgb_lit_cycles;   // time any RGB channel was on
+    uint64_t idle_waits;       // hal_idle() calls
+    uint64_t idle_cycles;      // time the core spent stopped in hal_idle()
+    uint64_t dma_cells;        // DMA cell transfers (no CPU cycles charged)
+    uint64_t uart_bytes;       // bytes sent on UART4
+    uint64_t uart_dma_blocks;  // hal_dma_uart() transfers
+    uint64_t pmp_cycles;       // PMP bus cycles, CPU or DMA
+    uint64_t pmp_dma_blocks;   // hal_dma_pmp() transfers
+    uint64_t nvm_programs;     // flash word writes
+    uint64_t nvm_erases;       // flash page erases
+    uint64_t nvm_stall_cycles; // core stalled by flash operations
+    uint64_t timer5_missed;    // Timer5 periods swallowed by a stall
+};
+
+uint64_t sim_cycles(void);
+void sim_advance(uint32_t cycles);
+
+void sim_key(int row, int col, int down);   // row/col as returned by scan_keypad (1..4)
+void sim_switch(int index, int on);         // SW0..SW3
+void sim_adc_set(int channel, unsigned int value);
+void sim_adc_noise(int channel, unsigned int lsb);   // uniform +/- lsb per conversion
+void sim_lcd_connect(int on);               // 0: the panel stops answering
+
+// Cyclic DMA channels: while held, Timer3 events skip them and only
+// sim_dma_step() moves them, one cell each, without time passing
+void sim_dma_hold(int on);
+void sim_dma_step(void);
+uint32_t sim_latch(hal_port_t port);        // LATx, free of charge
+
+void sim_lcd_text(int row, char out[17]);
+const unsigned char *sim_lcd_cgram(void);
+const struct sim_stats *sim_get_stats(void);
+void sim_report(void);
+void sim_dump_line(const char *line);   // appends to $SIM_DUMP
+
+#endif
@@ -0,0 +1,85 @@
+#include "idle.h"
+
+// idle_since/idle_sleeping are set by main() right before WAIT and cleared by
+// the first ISR that wakes it. An interrupt between the two writes and WAIT
+// makes the core sleep unbooked until the next one, which Timer5 bounds to
+// one tick counted as busy.
+static volatile uint32_t idle_since;
+static volatile int idle_sleeping;
+static volatile uint64_t idle_total;
+static volatile uint32_t idle_count;
+
+// Window state, Timer5ISR only
+static uint32_t idle_window_ticks;
+static uint32_t idle_window_start;
+static uint64_t idle_window_idle;
+static volatile unsigned int idle_busy;
+static volatile unsigned int idle_peak;
+
+void idle_wait(void)
+{
+    idle_since = tb_ticks();
+    idle_sleeping = 1;
+    idle_count++;
+    hal_idle();
+}
+
+// The ADC ISR (priority 3) can be preempted by Timer5 or CN (priority 4), so
+// the test and the clear must not be split or one wake-up is booked twice
+void idle_wake(void)
+{
+    uint32_t irq = hal_irq_save();
+
+    if (idle_sleeping) {
+        idle_sleeping = 0;
+        idle_total += tb_ticks() - idle_since;
+    }
+    hal_irq_restore(irq);
+}
+
+void idle_tick(void)
+{
+    uint32_t now, span, slept;
+
+    if (++idle_window_ticks < T5_TICKS_MS(IDLE_WINDOW_MS))
+        return;
+    idle_window_ticks = 0;
+
+    now = tb_ticks();
+    span = now - idle_window_start;
+    slept = (uint32_t)(idle_total - idle_window_idle);
+    idle_window_start = now;
+    idle_window_idle = idle_total;
+
+    if (span == 0 || slept > span)
+        return;
+    idle_busy = 1000 - (unsigned int)((uint64_t)slept * 1000 / span);
+    if (idle_busy > idle_peak)
+        idle_peak = idle_busy;
+}
+
+unsigned int idle_busy_permille(void)
+{
+    return idle_busy;
+}
+
+unsigned int idle_peak_permille(void)
+{
+    return idle_peak;
+}
+
+uint64_t idle_ticks_total(void)
+{
+    uint64_t t;
+
+    // 64-bit value written by the ISRs: read until stable
+    do {
+        t = idle_total;
+    } while (t != idle_total);
+    return t;
+}
+
+uint32_t idle_waits(void)
+{
+    return idle_count;
+}
@@ -0,0 +1,24 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+// CPU idle and utilization accounting. main() calls idle_wait() whenever it
+// has nothing to do; the core stops on WAIT until the next interrupt. Every
+// ISR starts with idle_wake(), so the time spent stopped is booked exactly
+// and the ISR itself counts as busy.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#define IDLE_WINDOW_MS 1000   // utilization is reported over this window
+
+void idle_wait(void);
+void idle_wake(void);                      // first statement of every ISR
+void idle_tick(void);                      // from Timer5ISR, closes the window
+
+// Debug API
+unsigned int idle_busy_permille(void);     // busy share of the last full window
+unsigned int idle_peak_permille(void);     // highest window since reset
+uint64_t idle_ticks_total(void);           // core timer ticks spent stopped
+uint32_t idle_waits(void);
+
+#endif
@@ -0,0 +1,194 @@
+#include "hal.h"
+#include "keypad.h"
+#include "timebase.h"
+
+#define KP_QUEUE_SIZE 16   // power of two
+
+// One full matrix pass every 4 Timer5 ticks
+#define KP_SCAN_US          (4 * T5_TICK_US)
+#define KP_DEBOUNCE_SCANS   (KEY_DEBOUNCE_MS * 1000 / KP_SCAN_US)
+#define KP_REPEAT_DELAY     (KEY_REPEAT_DELAY_MS * 1000 / KP_SCAN_US)
+#define KP_REPEAT_SCANS     (KEY_REPEAT_MS * 1000 / KP_SCAN_US)
+
+struct kp_pin {
+    hal_port_t port;
+    uint32_t mask;
+};
+
+static const struct kp_pin kp_rows[4] = {
+    { PIN_KEY_ROW1 }, { PIN_KEY_ROW2 }, { PIN_KEY_ROW3 }, { PIN_KEY_ROW4 }
+};
+
+char scan_key[] = {
+    0x44, '1',  0x34, '2',  0x24, '3',  0x14, 'A',
+    0x43, '4',  0x33, '5',  0x23, '6',  0x13, 'B',
+    0x42, '7',  0x32, '8',  0x22, '9',  0x12, 'C',
+    0x41, '0',  0x31, 'F',  0x21, 'E',  0x11, 'D'
+};
+
+// Event ring: the ISR only advances kp_q_head, main() only kp_q_tail
+static volatile struct key_event kp_q[KP_QUEUE_SIZE];
+static volatile unsigned char kp_q_head;
+static volatile unsigned char kp_q_tail;
+
+// Scanner state, touched only at interrupt priority 4
+static volatile int kp_scanning;
+static int kp_row;
+static unsigned int kp_raw;          // this pass, bit (row-1)*4 + (col-1)
+static volatile unsigned int kp_state;
+static unsigned char kp_count[16];   // consecutive scans disagreeing with kp_state
+static unsigned short kp_held[16];   // scans since press, for repeat
+
+static void kp_push(unsigned char type, unsigned char code)
+{
+    unsigned char next = (kp_q_head + 1) & (KP_QUEUE_SIZE - 1);
+
+    if (next == kp_q_tail)
+        return;   // full: drop, main() is not listening
+    kp_q[kp_q_head].type = type;
+    kp_q[kp_q_head].code = code;
+    kp_q_head = next;
+}
+
+static unsigned int kp_columns(void)
+{
+    // Active-LOW with pull-ups
+    return (!hal_read(PIN_KEY_COL1) << 0) | (!hal_read(PIN_KEY_COL2) << 1) |
+           (!hal_read(PIN_KEY_COL3) << 2) | (!hal_read(PIN_KEY_COL4) << 3);
+}
+
+static void kp_drive_row(int row)
+{
+    int r;
+
+    for (r = 0; r < 4; r++)
+        hal_write(kp_rows[r].port, kp_rows[r].mask, r != row);
+}
+
+// All rows LOW: any key pulls its column down and raises a change notice
+static void kp_idle(void)
+{
+    int r;
+
+    for (r = 0; r < 4; r++)
+        hal_clr(kp_rows[r].port, kp_rows[r].mask);
+    hal_cn_ack(HAL_PORT_C);
+    hal_cn_ack(HAL_PORT_G);
+    kp_scanning = 0;
+    hal_cn_irq(HAL_PORT_C, 1);
+    hal_cn_irq(HAL_PORT_G, 1);
+}
+
+void keypad_init(void)
+{
+    hal_cn_init(4);   // same priority as Timer5: the two never preempt each other
+    hal_cn_enable(HAL_PORT_C, HAL_PIN_MASK(PIN_KEY_COL1));
+    hal_cn_enable(HAL_PORT_G, HAL_PIN_MASK(PIN_KEY_COL2) | HAL_PIN_MASK(PIN_KEY_COL3) | HAL_PIN_MASK(PIN_KEY_COL4));
+    kp_idle();
+}
+
+void keypad_change(void)
+{
+    hal_cn_ack(HAL_PORT_C);
+    hal_cn_ack(HAL_PORT_G);
+    if (kp_scanning)
+        return;
+
+    // Hand over to the tick-driven scanner until every key is released
+    hal_cn_irq(HAL_PORT_C, 0);
+    hal_cn_irq(HAL_PORT_G, 0);
+    kp_row = 0;
+    kp_raw = 0;
+    kp_drive_row(0);
+    kp_scanning = 1;
+}
+
+static void kp_debounce(void)
+{
+    int k;
+
+    for (k = 0; k < 16; k++) {
+        unsigned int bit = 1u << k;
+        unsigned char code = (unsigned char)(((k / 4 + 1) << 4) | (k % 4 + 1));
+        int down = (kp_state & bit) != 0;
+
+        if (((kp_raw & bit) != 0) == down) {
+            kp_count[k] = 0;
+            if (down && ++kp_held[k] >= KP_REPEAT_DELAY) {
+                kp_push(KEY_REPEAT, code);
+                kp_held[k] = KP_REPEAT_DELAY - KP_REPEAT_SCANS;
+            }
+            continue;
+        }
+        if (++kp_count[k] < KP_DEBOUNCE_SCANS)
+            continue;
+
+        kp_count[k] = 0;
+        kp_held[k] = 0;
+        kp_state ^= bit;
+        kp_push(down ? KEY_RELEASE : KEY_PRESS, code);
+    }
+}
+
+// One row per tick: the row driven on the previous tick has had 250 us to settle
+void keypad_tick(void)
+{
+    if (!kp_scanning)
+        return;
+
+    kp_raw |= kp_columns() << (kp_row * 4);
+    if (++kp_row < 4) {
+        kp_drive_row(kp_row);
+        return;
+    }
+
+    kp_debounce();
+    if (kp_raw == 0 && kp_state == 0) {
+        kp_idle();
+        return;
+    }
+    kp_row = 0;
+    kp_raw = 0;
+    kp_drive_row(0);
+}
+
+int keypad_get_event(struct key_event *ev)
+{
+    if (kp_q_tail == kp_q_head)
+        return 0;
+    ev->type = kp_q[kp_q_tail].type;
+    ev->code = kp_q[kp_q_tail].code;
+    kp_q_tail = (kp_q_tail + 1) & (KP_QUEUE_SIZE - 1);
+    return 1;
+}
+
+void keypad_flush(void)
+{
+    kp_q_tail = kp_q_head;
+}
+
+unsigned int keypad_down(void)
+{
+    return kp_state;
+}
+
+char keypad_char(int code)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(scan_key); i += 2)
+        if (scan_key[i] == code)
+            return scan_key[i + 1];
+    return 0;
+}
+
+// Non-blocking: code of the next key press, 0 if none is queued
+int scan_keypad(void)
+{
+    struct key_event ev;
+
+    while (keypad_get_event(&ev))
+        if (ev.type == KEY_PRESS)
+            return ev.code;
+    return 0;
+}
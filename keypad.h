@@ -0,0 +1,32 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+// 4x4 matrix keypad: change notification on the columns (RC3/RG7/RG8/RG9)
+// wakes a row-by-row scan driven from the Timer5 tick. Every key is debounced
+// on its own and press/release/repeat events go into a queue for main().
+// Key codes are (row << 4) | col, rows and columns numbered 1..4.
+
+#define KEY_PRESS   1
+#define KEY_RELEASE 2
+#define KEY_REPEAT  3
+
+#define KEY_DEBOUNCE_MS     20
+#define KEY_REPEAT_DELAY_MS 500
+#define KEY_REPEAT_MS       150
+
+struct key_event {
+    unsigned char type;
+    unsigned char code;
+};
+
+void keypad_init(void);
+void keypad_tick(void);      // Timer5ISR
+void keypad_change(void);    // change-notification ISR
+
+int keypad_get_event(struct key_event *ev);
+void keypad_flush(void);
+unsigned int keypad_down(void);   // debounced state, bit (row-1)*4 + (col-1)
+char keypad_char(int code);
+int scan_keypad(void);
+
+#endif
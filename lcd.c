@@ -0,0 +1,494 @@
+#include <string.h>
+#include "hal.h"
+#include "lcd.h"
+#include "timebase.h"
+#include "idle.h"
+#include "prof.h"
+#include "ssd.h"
+
+// A free DMA channel exists only when the seven-segment display does not
+// hold all four
+#ifndef LCD_USE_DMA
+#define LCD_USE_DMA (LCD_USE_PMP && !SSD_USE_DMA)
+#endif
+#define LCD_DMA_CHANNEL 2
+#define LCD_DMA_MIN     2    // shorter runs go out from lcd_service() directly
+#define LCD_DMA_MAX     32
+
+// Bus timing from the HD44780 datasheet: address setup, enable pulse width,
+// hold. At PBCLK = 80 MHz the PMP's longest strobe is 16 cycles (200 ns),
+// still far wider than the bit-banged pulse.
+#define LCD_TAS_NS  40
+#define LCD_PWEH_NS 230
+#define LCD_TH_NS   10
+
+// Worst-case execution times: 37 + 4 us (data write, short command) and
+// 1.52 ms (clear, home) at the typical 270 kHz oscillator, scaled to the
+// 190 kHz minimum. DMA cells are paced by Timer4 at the short one.
+#define LCD_EXEC_US      59
+#define LCD_EXEC_LONG_US 2160
+#define LCD_T4_TCKPS     3   // 1:8 -> 10 MHz
+#define LCD_T4_PR        (HAL_PBCLK_HZ / 8 / 1000000 * LCD_EXEC_US - 1)
+
+#define LCD_BUSY_FLAG 0x80
+#define LCD_RETRY_MS  1000   // between setup attempts on a dead panel
+
+// POLLED latency: one transfer in LCD_LAT_SAMPLE is followed through to the
+// busy flag clearing, which holds Timer5ISR for up to LCD_EXEC_US. 1 times all.
+#ifndef LCD_LAT_SAMPLE
+#define LCD_LAT_SAMPLE 8     // power of two
+#endif
+
+static unsigned char fb_shadow[LCD_ROWS][LCD_COLS];  // what the game wants shown
+static unsigned char fb_panel[LCD_ROWS][LCD_COLS];   // what DDRAM holds
+static int fb_panel_valid;
+
+// Transfer queue drained by lcd_service() from Timer5ISR. Entries hold the
+// byte in bits 7..0 and RS in bit 8. Single producer (main), single consumer
+// (ISR): only main advances lcd_q_head, only the ISR advances lcd_q_tail.
+// init_lcd() empties it before interrupts are enabled.
+#define LCD_QUEUE_SIZE 64   // power of two
+#define LCD_Q_RS       0x100
+
+static volatile unsigned short lcd_q[LCD_QUEUE_SIZE];
+static volatile unsigned char lcd_q_head;
+static volatile unsigned char lcd_q_tail;
+
+#if LCD_USE_DMA
+static unsigned char lcd_dma_buf[LCD_DMA_MAX];   // read by DMA until the block ends
+#endif
+
+static int lcd_mode = LCD_TIMING;
+static volatile int lcd_sync;         // init_lcd() owns the bus, lcd_service() keeps off
+static volatile int lcd_fault;        // busy timeout: set by the ISR, cleared by lcd_recover()
+static uint32_t lcd_retry_at;
+static uint32_t lcd_ready_at;         // TIMED: previous transfer has executed
+static uint32_t lcd_last;             // tb_ticks() of the previous transfer
+static int lcd_watch;                 // POLLED: lcd_last not yet seen through
+static unsigned char lcd_issue_count;
+static int lcd_busy_seen;
+static uint32_t lcd_busy_since;       // POLLED: first busy read for the head entry
+static struct cycle_stats lcd_lat[2];
+static volatile uint32_t lcd_timeout_count;
+static uint32_t lcd_reset_count;
+
+static void lcd_strobe(int rs, unsigned char value)
+{
+#if LCD_USE_PMP
+    hal_pmp_write(rs, value);   // PMA0 = RS
+#else
+    hal_write(PIN_LCD_RS, rs);
+    hal_clr(PIN_LCD_RW); // RW = 0
+    hal_reg_write(PORT_LCD_DATA, HAL_REG_LAT, value);
+    hal_set(PIN_LCD_EN);
+    hal_clr(PIN_LCD_EN);
+#endif
+}
+
+// Worst case for the command class: clear and return home are the slow ones
+static uint32_t lcd_exec_ticks(unsigned short entry)
+{
+    if (!(entry & LCD_Q_RS) && (entry & 0xFF) <= 0x03)
+        return LCD_EXEC_LONG_US * TB_TICKS_PER_US;
+    return LCD_EXEC_US * TB_TICKS_PER_US;
+}
+
+// Function set, display on, entry mode, clear
+static const unsigned char lcd_init_seq[4] = { 0x38, 0x0C, 0x06, LCD_CLEAR };
+
+static uint32_t lcd_hash = 2166136261u;
+static uint32_t lcd_count;
+
+static void lcd_enqueue(unsigned short entry)
+{
+    unsigned char next = (lcd_q_head + 1) & (LCD_QUEUE_SIZE - 1);
+
+    while (next == lcd_q_tail)
+        idle_wait();   // full: Timer5 frees a slot every tick
+    lcd_q[lcd_q_head] = entry;
+    lcd_q_head = next;
+}
+
+static void lcd_push(unsigned short entry)
+{
+    lcd_hash = (lcd_hash ^ entry) * 16777619u;
+    lcd_count++;
+    lcd_enqueue(entry);
+}
+
+// Power-on setup on the bare bus; returns 0 on a busy timeout
+static int lcd_panel_init(void)
+{
+    int i, ok = 1;
+
+    lcd_sync = 1;
+#if LCD_USE_DMA
+    while (hal_dma_busy(LCD_DMA_CHANNEL))
+        ;
+#endif
+#if LCD_USE_PMP
+    hal_pmp_init(LCD_TAS_NS, LCD_PWEH_NS, LCD_TH_NS);
+#endif
+#if LCD_USE_DMA
+    hal_timer4_event_init(LCD_T4_TCKPS, LCD_T4_PR);
+#endif
+    lcd_q_tail = lcd_q_head;
+    for (i = 0; i < 4 && ok; i++) {
+        lcd_strobe(0, lcd_init_seq[i]);
+        if (lcd_mode == LCD_TIMING_TIMED)
+            delay_us(lcd_exec_ticks(lcd_init_seq[i]) / TB_TICKS_PER_US);
+        else
+            ok = busy();
+    }
+    delay_ms(250);
+
+    lcd_busy_seen = 0;
+    lcd_watch = 0;
+    lcd_last = lcd_ready_at = tb_ticks();
+    lcd_retry_at = tb_deadline_ms(LCD_RETRY_MS);
+    lcd_fault = !ok;
+    lcd_sync = 0;
+    return ok;
+}
+
+void init_lcd(void)
+{
+    // Runs before interrupts are enabled, so drive the bus synchronously
+    lcd_panel_init();
+
+    // Panel was just cleared
+    memset(fb_shadow, ' ', sizeof(fb_shadow));
+    memset(fb_panel, ' ', sizeof(fb_panel));
+    fb_panel_valid = 1;
+}
+
+// After a busy timeout: queue the setup commands again (at most once per
+// LCD_RETRY_MS) and let the next flush redraw the whole shadow. The panel
+// still has power, so there is no power-on delay, and lcd_service() paces
+// the commands like any other: nothing here waits on the panel. A panel that
+// is still dead times out again and drops the queue.
+static void lcd_recover(void)
+{
+    int i;
+
+    if (!lcd_fault || !tb_expired(lcd_retry_at))
+        return;
+    lcd_reset_count++;
+    lcd_retry_at = tb_deadline_ms(LCD_RETRY_MS);
+
+    // lcd_service() drops anything still queued on its next tick
+    while (lcd_q_tail != lcd_q_head)
+        idle_wait();
+    lcd_fault = 0;
+    for (i = 0; i < 4; i++)
+        lcd_enqueue(lcd_init_seq[i]);
+
+    memset(fb_panel, ' ', sizeof(fb_panel));
+    fb_panel_valid = 1;
+}
+
+void lcd_set_timing(int mode)
+{
+    lcd_wait_idle();
+    lcd_watch = 0;
+    lcd_mode = mode;
+}
+
+int lcd_timing(void)
+{
+    return lcd_mode;
+}
+
+void lcd_write_str(const char *str)
+{
+    while (*str)
+        lcd_data(*str++);
+}
+
+// Queued: returns at once, the transfer happens on a later Timer5 tick
+void lcd_cmd(unsigned char cmd)
+{
+    lcd_push(cmd);
+}
+
+void lcd_data(unsigned char data)
+{
+    lcd_push(LCD_Q_RS | data);
+}
+
+// Block until every queued transfer has reached the panel (or been dropped)
+void lcd_wait_idle(void)
+{
+    lcd_recover();
+    while (lcd_q_tail != lcd_q_head)
+        idle_wait();
+}
+
+uint32_t lcd_digest(void)
+{
+    return lcd_hash;
+}
+
+uint32_t lcd_writes(void)
+{
+    return lcd_count;
+}
+
+int lcd_pending(void)
+{
+    return (lcd_q_head - lcd_q_tail) & (LCD_QUEUE_SIZE - 1);
+}
+
+const struct cycle_stats *lcd_latency(int mode)
+{
+    return &lcd_lat[mode & 1];
+}
+
+uint32_t lcd_timeouts(void)
+{
+    return lcd_timeout_count;
+}
+
+uint32_t lcd_resets(void)
+{
+    return lcd_reset_count;
+}
+
+// One status read, no spinning: returns 1 while the panel is executing
+static int lcd_status_busy(void)
+{
+#if LCD_USE_PMP
+    return (hal_pmp_read(0) & LCD_BUSY_FLAG) != 0;
+#else
+    int busy_flag;
+
+    hal_set(PIN_LCD_RW); // RW = 1
+    hal_clr(PIN_LCD_RS); // RS = 0
+    hal_input(PIN_LCD_BUSY); // RE7
+    hal_set(PIN_LCD_EN);
+    hal_nop();
+    busy_flag = hal_read(PIN_LCD_BUSY);
+    hal_clr(PIN_LCD_EN);
+    hal_output(PIN_LCD_BUSY);
+    hal_clr(PIN_LCD_RW);
+    return busy_flag;
+#endif
+}
+
+// 1 once the head entry may go out. POLLED turns a busy flag that outlasts
+// LCD_BUSY_TIMEOUT_US into a fault.
+static int lcd_ready(uint32_t now)
+{
+    if (lcd_mode == LCD_TIMING_TIMED)
+        return (int32_t)(now - lcd_ready_at) >= 0;
+
+    if (!lcd_status_busy()) {
+        if (lcd_watch)
+            cycle_stats_add(&lcd_lat[LCD_TIMING_POLLED], lcd_last);
+        lcd_watch = 0;
+        lcd_busy_seen = 0;
+        return 1;
+    }
+    if (!lcd_busy_seen) {
+        lcd_busy_seen = 1;
+        lcd_busy_since = now;
+    } else if (now - lcd_busy_since >= LCD_BUSY_TIMEOUT_US * TB_TICKS_PER_US) {
+        lcd_busy_seen = 0;
+        lcd_watch = 0;
+        lcd_timeout_count++;
+        lcd_fault = 1;
+    }
+    return 0;
+}
+
+// TIMED always waits the worst case; a sampled POLLED transfer is timed by
+// the first status read that finds the panel idle again
+static void lcd_issued(uint32_t now, uint32_t exec)
+{
+    lcd_last = now;
+    lcd_ready_at = now + exec;
+    if (lcd_mode == LCD_TIMING_TIMED)
+        cycle_stats_put(&lcd_lat[LCD_TIMING_TIMED], exec * 2);
+    else
+        lcd_watch = (lcd_issue_count++ & (LCD_LAT_SAMPLE - 1)) == 0;
+}
+
+// Keep reading the status of a sampled byte for up to one short execution
+// time, so its latency is not rounded up to the next tick. Clear / home
+// outlast this and are seen through by later ticks.
+static void lcd_settle(void)
+{
+    while (lcd_watch && !lcd_fault && !tb_elapsed(lcd_last, LCD_EXEC_US * TB_TICKS_PER_US))
+        lcd_ready(tb_ticks());
+}
+
+#if LCD_USE_DMA
+// A run of data bytes at the queue tail (a line, a CGRAM glyph) becomes one
+// DMA block. Returns 0 if the run is too short to be worth it.
+static int lcd_dma_run(uint32_t now)
+{
+    unsigned char head = lcd_q_head;
+    unsigned char i = lcd_q_tail;
+    int n = 0;
+
+    while (i != head && n < LCD_DMA_MAX && (lcd_q[i] & LCD_Q_RS)) {
+        lcd_dma_buf[n++] = lcd_q[i] & 0xFF;
+        i = (i + 1) & (LCD_QUEUE_SIZE - 1);
+    }
+    if (n < LCD_DMA_MIN)
+        return 0;
+    hal_dma_pmp(LCD_DMA_CHANNEL, 1, lcd_dma_buf, n);
+    // First cell within one Timer4 period, then one per period
+    lcd_issued(now, (uint32_t)(n + 1) * LCD_EXEC_US * TB_TICKS_PER_US);
+    lcd_q_tail = i;
+    return 1;
+}
+#endif
+
+// Called from Timer5ISR: issue at most one queued transfer (or DMA block) per tick
+void lcd_service(void)
+{
+    unsigned short entry;
+    uint32_t now;
+    int ready;
+
+    if (lcd_sync)
+        return;
+#if LCD_USE_DMA
+    if (hal_dma_busy(LCD_DMA_CHANNEL))
+        return;
+#endif
+    if (lcd_q_tail == lcd_q_head) {
+        if (lcd_watch && !lcd_fault)
+            lcd_ready(tb_ticks());   // the last transfer of a burst
+        return;
+    }
+    now = tb_ticks();
+    ready = !lcd_fault && lcd_ready(now);
+    if (lcd_fault) {
+        lcd_q_tail = lcd_q_head;   // nothing reaches the panel until lcd_recover()
+        return;
+    }
+    if (!ready)
+        return;
+
+#if LCD_USE_DMA
+    if (lcd_dma_run(now))
+        return;
+#endif
+    entry = lcd_q[lcd_q_tail];
+    lcd_strobe((entry & LCD_Q_RS) != 0, entry & 0xFF);
+    lcd_issued(now, lcd_exec_ticks(entry));
+    lcd_q_tail = (lcd_q_tail + 1) & (LCD_QUEUE_SIZE - 1);
+    lcd_settle();
+}
+
+// Synchronous wait for the busy flag, bounded by LCD_BUSY_TIMEOUT_US
+int busy(void)
+{
+    uint32_t start = tb_ticks();
+    int ok = 1;
+#if LCD_USE_PMP
+    PROF_ENTER(PROF_LCD_BUSY);
+    while (hal_pmp_read(0) & LCD_BUSY_FLAG) {
+        if (tb_elapsed(start, LCD_BUSY_TIMEOUT_US * TB_TICKS_PER_US)) {
+            ok = 0;
+            break;
+        }
+    }
+#else
+    char RD, RS;
+    uint32_t STATUS_TRISE;
+    PROF_ENTER(PROF_LCD_BUSY);
+
+    RD = hal_latch(PIN_LCD_RW);
+    RS = hal_latch(PIN_LCD_RS);
+    STATUS_TRISE = hal_reg_read(PORT_LCD_DATA, HAL_REG_TRIS);
+    hal_set(PIN_LCD_RW); // RW = 1
+    hal_clr(PIN_LCD_RS); // RS = 0
+    hal_input(PIN_LCD_BUSY); // RE7
+
+    do {
+        hal_set(PIN_LCD_EN);
+        hal_nop();
+        hal_clr(PIN_LCD_EN);
+        if (tb_elapsed(start, LCD_BUSY_TIMEOUT_US * TB_TICKS_PER_US)) {
+            ok = 0;
+            break;
+        }
+    } while (hal_read(PIN_LCD_BUSY));
+
+    hal_write(PIN_LCD_RW, RD);
+    hal_write(PIN_LCD_RS, RS);
+    hal_reg_write(PORT_LCD_DATA, HAL_REG_TRIS, STATUS_TRISE);
+#endif
+    if (!ok)
+        lcd_timeout_count++;
+    PROF_LEAVE(PROF_LCD_BUSY);
+    return ok;
+}
+
+// === Shadow framebuffer ===
+void lcd_fb_clear(void)
+{
+    memset(fb_shadow, ' ', sizeof(fb_shadow));
+}
+
+void lcd_fb_put_char(int row, int col, unsigned char c)
+{
+    if (row < 0 || row >= LCD_ROWS || col < 0 || col >= LCD_COLS)
+        return;
+    fb_shadow[row][col] = c;
+}
+
+void lcd_fb_put_str(int row, int col, const char *str)
+{
+    while (*str && col < LCD_COLS)
+        lcd_fb_put_char(row, col++, *str++);
+}
+
+// Replace the whole screen, the flush only touches what differs
+void lcd_fb_show(const char *line1, const char *line2)
+{
+    lcd_fb_clear();
+    lcd_fb_put_str(0, 0, line1);
+    lcd_fb_put_str(1, 0, line2);
+    lcd_fb_flush();
+}
+
+// Forget what the panel shows, e.g. after raw lcd_cmd/lcd_data writes
+void lcd_fb_invalidate(void)
+{
+    fb_panel_valid = 0;
+}
+
+// Returns the number of bus transfers issued
+int lcd_fb_flush(void)
+{
+    int transfers = 0;
+    int row, col;
+
+    lcd_recover();
+
+    for (row = 0; row < LCD_ROWS; row++) {
+        col = 0;
+        while (col < LCD_COLS) {
+            if (fb_panel_valid && fb_shadow[row][col] == fb_panel[row][col]) {
+                col++;
+                continue;
+            }
+
+            // One address set, then let the entry mode auto-increment
+            lcd_cmd((row ? LCD_LINE2 : LCD_LINE1) + col);
+            transfers++;
+            while (col < LCD_COLS && (!fb_panel_valid || fb_shadow[row][col] != fb_panel[row][col])) {
+                lcd_data(fb_shadow[row][col]);
+                fb_panel[row][col] = fb_shadow[row][col];
+                transfers++;
+                col++;
+            }
+        }
+    }
+    fb_panel_valid = 1;
+    return transfers;
+}
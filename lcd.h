@@ -0,0 +1,73 @@
+#ifndef LCD_H
+#define LCD_H
+
+#include <stdint.h>
+#include "timebase.h"
+
+// HD44780 16x2 driver (RS = RB15, RW = RD5, EN = RD4, data on PORTE)
+
+// 1: the Parallel Master Port runs the bus cycles (these are its PMA0, PMRD/
+//    PMWR, PMENB and PMD pins); with SSD_USE_DMA=0 runs of data bytes also
+//    go out as DMA blocks.
+// 0: bit-banged GPIO (fallback).
+#ifndef LCD_USE_PMP
+#define LCD_USE_PMP 1
+#endif
+
+// When the next transfer may go out:
+// POLLED  read the busy flag. A panel still busy after LCD_BUSY_TIMEOUT_US is
+//         a fault: the queue is dropped and the next draw queues the setup
+//         commands again.
+// TIMED   wait the datasheet worst case for the previous command's class
+//         (clear / home or anything else) on the core timer. Never drives RW
+//         high and never reads the panel.
+#define LCD_TIMING_POLLED 0
+#define LCD_TIMING_TIMED  1
+#ifndef LCD_TIMING
+#define LCD_TIMING LCD_TIMING_POLLED
+#endif
+#define LCD_BUSY_TIMEOUT_US 5000
+
+#define LCD_CLEAR 0x01
+#define LCD_LINE1 0x80
+#define LCD_LINE2 0xC0
+
+#define LCD_ROWS 2
+#define LCD_COLS 16
+
+void init_lcd(void);
+void lcd_cmd(unsigned char cmd);
+void lcd_data(unsigned char data);
+void lcd_write_str(const char *str);
+int busy(void);                    // 0 if the panel stayed busy past LCD_BUSY_TIMEOUT_US
+
+void lcd_set_timing(int mode);
+int lcd_timing(void);
+
+// lcd_cmd/lcd_data only queue the transfer; Timer5ISR drains the queue
+// through lcd_service() once the busy flag clears.
+void lcd_service(void);
+void lcd_wait_idle(void);
+int lcd_pending(void);
+
+// Per timing mode: SYSCLK cycles from issuing a transfer until the panel can
+// take the next one (POLLED: the busy flag reads clear, TIMED: the worst-case
+// execution time has passed)
+const struct cycle_stats *lcd_latency(int mode);
+uint32_t lcd_timeouts(void);
+uint32_t lcd_resets(void);         // panel re-setups; CGRAM caches compare this
+
+// FNV-1a over every queued transfer (RS and byte) since init_lcd()
+uint32_t lcd_digest(void);
+uint32_t lcd_writes(void);
+
+// Shadow framebuffer: draw into RAM, lcd_fb_flush() sends only the cells that
+// differ from what the panel shows, one DDRAM address set per run of changes.
+void lcd_fb_clear(void);
+void lcd_fb_put_char(int row, int col, unsigned char c);
+void lcd_fb_put_str(int row, int col, const char *str);
+int lcd_fb_flush(void);
+void lcd_fb_show(const char *line1, const char *line2);
+void lcd_fb_invalidate(void);
+
+#endif
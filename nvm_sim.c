@@ -0,0 +1,151 @@
+// Host NOR flash model with power-cut injection, see nvm_sim.h
+#ifdef HAL_SIM
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nvm_sim.h"
+
+static uint32_t cells[NVM_SIM_WORDS];
+static unsigned long erases[HAL_NVM_PAGES];
+static unsigned long ops;
+static long cut_at = -1;
+static int dead;
+static uint32_t seed = 1;
+static int initialised;
+
+static void nvm_init(void)
+{
+    if (initialised)
+        return;
+    initialised = 1;
+    memset(cells, 0xFF, sizeof(cells));
+}
+
+static uint32_t nvm_rand(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed;
+}
+
+static uint32_t nvm_rand32(void)
+{
+    return (nvm_rand() >> 16) | (nvm_rand() & 0xFFFF0000u);
+}
+
+// Counts the operation; 1 when it is the one the power fails in
+static int nvm_cut(void)
+{
+    ops++;
+    if (cut_at >= 0 && (long)ops > cut_at) {
+        cut_at = -1;
+        dead = 1;
+        return 1;
+    }
+    return 0;
+}
+
+void nvm_sim_reset(void)
+{
+    initialised = 1;
+    memset(cells, 0xFF, sizeof(cells));
+    memset(erases, 0, sizeof(erases));
+    ops = 0;
+    cut_at = -1;
+    dead = 0;
+}
+
+uint32_t nvm_sim_read(unsigned int word)
+{
+    nvm_init();
+    return word < NVM_SIM_WORDS ? cells[word] : 0xFFFFFFFF;
+}
+
+int nvm_sim_program(unsigned int word, uint32_t value)
+{
+    nvm_init();
+    if (dead || word >= NVM_SIM_WORDS)
+        return 0;
+    if (nvm_cut()) {
+        cells[word] &= value | nvm_rand32();   // only some bits made it
+        return 0;
+    }
+    cells[word] &= value;
+    return 1;
+}
+
+int nvm_sim_erase(unsigned int page)
+{
+    uint32_t *p = &cells[page * HAL_NVM_PAGE_WORDS];
+    int i;
+
+    nvm_init();
+    if (dead || page >= HAL_NVM_PAGES)
+        return 0;
+    erases[page]++;
+    if (nvm_cut()) {
+        for (i = 0; i < HAL_NVM_PAGE_WORDS; i++)
+            if (nvm_rand() & 0x10000)
+                p[i] |= nvm_rand32();
+        return 0;
+    }
+    memset(p, 0xFF, HAL_NVM_PAGE_WORDS * sizeof(*p));
+    return 1;
+}
+
+void nvm_sim_cut_after(long n, uint32_t s)
+{
+    cut_at = n < 0 ? -1 : (long)ops + n;
+    seed = s ? s : 1;
+}
+
+int nvm_sim_powered(void)
+{
+    return !dead;
+}
+
+void nvm_sim_power_on(void)
+{
+    dead = 0;
+}
+
+unsigned long nvm_sim_ops(void)
+{
+    return ops;
+}
+
+unsigned long nvm_sim_erases(unsigned int page)
+{
+    return page < HAL_NVM_PAGES ? erases[page] : 0;
+}
+
+int nvm_sim_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    nvm_init();
+    if (!f)
+        return 0;
+    n = fread(cells, sizeof(cells[0]), NVM_SIM_WORDS, f);
+    fclose(f);
+    if (n != NVM_SIM_WORDS) {
+        memset(cells, 0xFF, sizeof(cells));
+        return 0;
+    }
+    return 1;
+}
+
+int nvm_sim_save(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    size_t n;
+
+    if (!f)
+        return 0;
+    nvm_init();
+    n = fwrite(cells, sizeof(cells[0]), NVM_SIM_WORDS, f);
+    return fclose(f) == 0 && n == NVM_SIM_WORDS;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef NVM_SIM_H
+#define NVM_SIM_H
+
+// NOR flash model behind hal_nvm_*() on the host: hal_sim.c wraps it for the
+// game simulator, tools/nvm_powercut.c drives it directly.
+//
+// Programming ANDs the new word into the cell, erase sets a page to all ones.
+// A power cut armed with nvm_sim_cut_after() tears one operation: a program
+// clears only a random subset of its bits, an erase leaves a random part of
+// the page untouched. Everything after the cut is dropped until
+// nvm_sim_power_on().
+
+#include <stdint.h>
+
+#include "hal.h"
+
+#define NVM_SIM_WORDS (HAL_NVM_PAGES * HAL_NVM_PAGE_WORDS)
+
+void nvm_sim_reset(void);                        // all pages erased, counters zero
+uint32_t nvm_sim_read(unsigned int word);
+int nvm_sim_program(unsigned int word, uint32_t value);   // 0 while the power is off
+int nvm_sim_erase(unsigned int page);
+
+void nvm_sim_cut_after(long ops, uint32_t seed); // tear operation ops + 1, -1 disarms
+int nvm_sim_powered(void);
+void nvm_sim_power_on(void);
+
+unsigned long nvm_sim_ops(void);                 // operations attempted so far
+unsigned long nvm_sim_erases(unsigned int page);
+
+int nvm_sim_load(const char *path);              // raw image, 0 if missing or short
+int nvm_sim_save(const char *path);
+
+#endif
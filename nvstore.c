@@ -0,0 +1,317 @@
+#include "hal.h"
+#include "nvstore.h"
+
+#define NVS_MAGIC   0x3153564Eu   // "NVS1"
+#define NVS_HDR     3             // magic, seq, ~seq
+#define NVS_ERASED  0xFFFFFFFFu
+#define NVS_REC_MAX NVS_KEYS      // payload words
+#define NVS_RETRIES HAL_NVM_PAGES // failed page switches in a row before giving up
+
+#define NVS_REC_SUMMARY 0x5A
+#define NVS_REC_SET     0xA5
+
+// nvs_record() results besides a payload length
+#define NVS_END  (-1)             // erased word: the log ends here
+#define NVS_TORN (-2)             // CRC or framing error
+
+enum {
+    NVS_IDLE,
+    NVS_ERASE,                    // page switch: erase, seq, ~seq, magic, summary
+    NVS_SEQ,
+    NVS_SEQ_INV,
+    NVS_MAGIC_W,
+    NVS_WRITE,                    // nvs_rec[] word by word
+    NVS_FAILED
+};
+
+static uint32_t nvs_val[NVS_KEYS];
+static uint32_t nvs_dirty;        // bit per key
+static int nvs_held;
+static int nvs_state;
+static int nvs_switch;            // next flush opens a fresh page
+static int nvs_failures;
+
+static int nvs_page = -1;
+static unsigned int nvs_pos;      // next free word in nvs_page
+static uint32_t nvs_top;          // highest seq seen on any page
+static int nvs_next;              // page being opened
+
+static uint32_t nvs_rec[2 + NVS_REC_MAX];
+static int nvs_rec_len;
+static int nvs_rec_done;
+
+static struct nvs_stats stats;
+
+static const uint16_t nvs_crc_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+static uint16_t nvs_crc(uint16_t crc, unsigned char b)
+{
+    crc = (uint16_t)(crc << 4) ^ nvs_crc_nibble[(crc >> 12) ^ (b >> 4)];
+    crc = (uint16_t)(crc << 4) ^ nvs_crc_nibble[(crc >> 12) ^ (b & 0x0F)];
+    return crc;
+}
+
+static uint16_t nvs_crc_word(uint16_t crc, uint32_t w)
+{
+    crc = nvs_crc(crc, (unsigned char)w);
+    crc = nvs_crc(crc, (unsigned char)(w >> 8));
+    crc = nvs_crc(crc, (unsigned char)(w >> 16));
+    return nvs_crc(crc, (unsigned char)(w >> 24));
+}
+
+static uint32_t nvs_read(int page, unsigned int pos)
+{
+    stats.boot_words++;
+    return hal_nvm_read(page * HAL_NVM_PAGE_WORDS + pos);
+}
+
+static int nvs_page_valid(int page, uint32_t *seq)
+{
+    // An interrupted erase only sets bits, so it cannot keep seq == ~~seq
+    *seq = nvs_read(page, 1);
+    return nvs_read(page, 0) == NVS_MAGIC && *seq == ~nvs_read(page, 2) && *seq != NVS_ERASED;
+}
+
+// Record at pos: payload length, NVS_END or NVS_TORN. An interrupted write
+// cannot leave its commit word equal to ~header, so the CRC is the second
+// line of defence, not the only one.
+static int nvs_record(int page, unsigned int pos, uint32_t *type, uint32_t payload[NVS_REC_MAX])
+{
+    uint32_t hdr;
+    uint16_t crc = 0xFFFF;
+    unsigned int words, i;
+
+    if (pos >= HAL_NVM_PAGE_WORDS)
+        return NVS_END;
+    hdr = nvs_read(page, pos);
+    if (hdr == NVS_ERASED)
+        return NVS_END;
+    *type = hdr >> 24;
+    words = (hdr >> 16) & 0xFF;
+    if (words > NVS_REC_MAX || pos + 2 + words > HAL_NVM_PAGE_WORDS)
+        return NVS_TORN;
+    if (nvs_read(page, pos + 1 + words) != ~hdr)
+        return NVS_TORN;
+    crc = nvs_crc(crc, (unsigned char)*type);
+    crc = nvs_crc(crc, (unsigned char)words);
+    for (i = 0; i < words; i++) {
+        payload[i] = nvs_read(page, pos + 1 + i);
+        crc = nvs_crc_word(crc, payload[i]);
+    }
+    return crc == (hdr & 0xFFFF) ? (int)words : NVS_TORN;
+}
+
+// Unknown or malformed records count as damage
+static int nvs_apply(uint32_t type, const uint32_t *payload, int words)
+{
+    int i;
+
+    if (type == NVS_REC_SUMMARY && words <= NVS_KEYS) {
+        for (i = 0; i < words; i++)
+            nvs_val[i] = payload[i];
+        return 1;
+    }
+    if (type == NVS_REC_SET && words == 2 && payload[0] < NVS_KEYS) {
+        nvs_val[payload[0]] = payload[1];
+        return 1;
+    }
+    return 0;
+}
+
+static void nvs_build(uint32_t type, const uint32_t *payload, int words)
+{
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    crc = nvs_crc(crc, (unsigned char)type);
+    crc = nvs_crc(crc, (unsigned char)words);
+    for (i = 0; i < words; i++) {
+        nvs_rec[1 + i] = payload[i];
+        crc = nvs_crc_word(crc, payload[i]);
+    }
+    nvs_rec[0] = type << 24 | (uint32_t)words << 16 | crc;
+    nvs_rec[1 + words] = ~nvs_rec[0];
+    nvs_rec_len = 2 + words;
+    nvs_rec_done = 0;
+}
+
+int nvs_init(const uint32_t defaults[NVS_KEYS])
+{
+    uint32_t payload[NVS_REC_MAX];
+    uint32_t type, seq, best_seq = 0;
+    int page, best = -1, n;
+    unsigned int pos;
+
+    for (n = 0; n < NVS_KEYS; n++)
+        nvs_val[n] = defaults[n];
+    nvs_dirty = 0;
+    nvs_state = NVS_IDLE;
+    nvs_switch = 0;
+    nvs_failures = 0;
+    nvs_top = 0;
+    stats = (struct nvs_stats){ 0 };
+
+    // Newest page with an intact summary; a newer one without is a switch
+    // the power cut short
+    for (page = 0; page < HAL_NVM_PAGES; page++) {
+        if (!nvs_page_valid(page, &seq))
+            continue;
+        if (seq > nvs_top)
+            nvs_top = seq;
+        if (nvs_record(page, NVS_HDR, &type, payload) >= 0 && type == NVS_REC_SUMMARY
+            && (best < 0 || seq > best_seq)) {
+            best = page;
+            best_seq = seq;
+        }
+    }
+
+    nvs_page = best;
+    stats.page = best;
+    if (best < 0)
+        return 0;
+
+    pos = NVS_HDR;
+    while ((n = nvs_record(best, pos, &type, payload)) >= 0 && nvs_apply(type, payload, n))
+        pos += 2 + n;
+    if (n != NVS_END || best_seq != nvs_top) {
+        nvs_switch = 1;   // never append behind damage
+        stats.recovered = 1;
+    }
+    nvs_pos = pos;
+    stats.seq = best_seq;
+    stats.used = pos;
+    return 1;
+}
+
+uint32_t nvs_get(enum nvs_key key)
+{
+    return nvs_val[key];
+}
+
+void nvs_set(enum nvs_key key, uint32_t value)
+{
+    if (nvs_val[key] == value)
+        return;
+    nvs_val[key] = value;
+    nvs_dirty |= 1u << key;
+}
+
+void nvs_hold(int on)
+{
+    nvs_held = on;
+}
+
+int nvs_pending(void)
+{
+    return nvs_state != NVS_FAILED && (nvs_state != NVS_IDLE || nvs_dirty || nvs_switch);
+}
+
+const struct nvs_stats *nvs_get_stats(void)
+{
+    return &stats;
+}
+
+// A failed operation abandons the page; the summary on the next one carries
+// whatever the lost record held
+static void nvs_fail(void)
+{
+    stats.errors++;
+    nvs_switch = 1;
+    nvs_state = ++nvs_failures > NVS_RETRIES ? NVS_FAILED : NVS_IDLE;
+}
+
+static void nvs_start(void)
+{
+    uint32_t payload[2];
+    int key;
+
+    if (nvs_switch || nvs_page < 0) {
+        nvs_next = (nvs_page + 1) % HAL_NVM_PAGES;
+        nvs_state = NVS_ERASE;
+        return;
+    }
+    for (key = 0; !(nvs_dirty & (1u << key)); key++)
+        ;
+    if (nvs_pos + 4 > HAL_NVM_PAGE_WORDS) {
+        nvs_switch = 1;
+        nvs_start();
+        return;
+    }
+    payload[0] = (uint32_t)key;
+    payload[1] = nvs_val[key];
+    nvs_build(NVS_REC_SET, payload, 2);
+    nvs_dirty &= ~(1u << key);
+    nvs_state = NVS_WRITE;
+}
+
+int nvs_service(void)
+{
+    unsigned int base = nvs_next * HAL_NVM_PAGE_WORDS;
+
+    if (nvs_held || !nvs_pending())
+        return 0;
+
+    switch (nvs_state) {
+        case NVS_IDLE:
+            nvs_start();
+            break;
+
+        case NVS_ERASE:
+            if (!hal_nvm_erase(nvs_next))
+                nvs_fail();
+            else
+                nvs_state = NVS_SEQ;
+            break;
+
+        case NVS_SEQ:
+            if (!hal_nvm_program(base + 1, nvs_top + 1))
+                nvs_fail();
+            else
+                nvs_state = NVS_SEQ_INV;
+            break;
+
+        case NVS_SEQ_INV:
+            if (!hal_nvm_program(base + 2, ~(nvs_top + 1)))
+                nvs_fail();
+            else
+                nvs_state = NVS_MAGIC_W;
+            break;
+
+        case NVS_MAGIC_W:
+            if (!hal_nvm_program(base, NVS_MAGIC)) {
+                nvs_fail();
+                break;
+            }
+            // The page is live from here on; its summary has every key
+            nvs_page = nvs_next;
+            nvs_pos = NVS_HDR;
+            nvs_top++;
+            nvs_switch = 0;
+            nvs_build(NVS_REC_SUMMARY, nvs_val, NVS_KEYS);
+            nvs_dirty = 0;
+            nvs_state = NVS_WRITE;
+            stats.page_switches++;
+            stats.page = nvs_page;
+            stats.seq = nvs_top;
+            break;
+
+        case NVS_WRITE:
+            if (!hal_nvm_program(nvs_page * HAL_NVM_PAGE_WORDS + nvs_pos + nvs_rec_done,
+                                 nvs_rec[nvs_rec_done])) {
+                nvs_fail();
+                break;
+            }
+            if (++nvs_rec_done == nvs_rec_len) {
+                nvs_pos += nvs_rec_len;
+                nvs_failures = 0;
+                stats.records++;
+                stats.used = nvs_pos;
+                nvs_state = NVS_IDLE;
+            }
+            break;
+    }
+    return nvs_pending();
+}
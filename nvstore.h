@@ -0,0 +1,56 @@
+#ifndef NVSTORE_H
+#define NVSTORE_H
+
+// Persistent game state in a log-structured record store on the HAL_NVM
+// pages. nvs_set() only changes RAM; nvs_service() appends the changes, one
+// flash word (or one page erase) per call, from the dispatcher's idle time.
+//
+// Page:   magic "NVS1", seq, ~seq, then records back to back.
+// Record: header word type << 24 | payload words << 16 | CRC16-CCITT-FALSE
+//         over type, length and payload, then the payload, then ~header.
+//         The commit word goes last, so a record counts only once complete.
+//   NVS_REC_SUMMARY  every key, always the first record of a page
+//   NVS_REC_SET      key, value
+//
+// Pages are taken round robin, so each is erased once per lap. A full page
+// (or a damaged one) makes the next flush open the following page with a
+// summary, which lets boot read only the newest page whose summary is intact.
+// A write torn by a power cut fails its commit word or CRC: everything before
+// it is kept and appending moves on to a fresh page.
+
+#include <stdint.h>
+
+enum nvs_key {
+    NVS_COINS,
+    NVS_CHARACTER,       // selected character
+    NVS_OWNED,           // bit n: character n bought
+    NVS_BEST_EASY,       // most coins in one run
+    NVS_BEST_HARD,
+    NVS_KEYS
+};
+
+struct nvs_stats {
+    uint32_t records;          // appended since boot
+    uint32_t page_switches;
+    uint32_t errors;           // failed program / erase operations
+    uint32_t seq;              // of the page being appended
+    int page;                  // -1 before the first write
+    unsigned int used;         // words used in that page
+    unsigned int boot_words;   // flash words nvs_init() read
+    int recovered;             // nvs_init() skipped a torn or damaged record
+};
+
+// Load the newest state; keys with nothing stored keep defaults[].
+// Returns 0 if the store was empty.
+int nvs_init(const uint32_t defaults[NVS_KEYS]);
+
+uint32_t nvs_get(enum nvs_key key);
+void nvs_set(enum nvs_key key, uint32_t value);   // RAM only, never touches flash
+
+void nvs_hold(int on);         // while held nvs_service() does nothing
+int nvs_service(void);         // nonzero while changes are still pending
+int nvs_pending(void);
+
+const struct nvs_stats *nvs_get_stats(void);
+
+#endif
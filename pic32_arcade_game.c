@@ -1,9 +1,39 @@
-#include <xc.h>
-#include <sys/attribs.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <xc.h>
-
+#include "hal.h"
+#include "lcd.h"
+#include "timebase.h"
+#include "ssd.h"
+#include "keypad.h"
+#include "switches.h"
+#include "adc.h"
+#include "sound.h"
+#include "playfield.h"
+#include "game.h"
+#include "glyph.h"
+#include "scroll.h"
+#include "fsm.h"
+#include "idle.h"
+#include "prof.h"
+#include "telemetry.h"
+#include "replay.h"
+#include "nvstore.h"
+#include "twheel.h"
+#include "rgbled.h"
+#ifdef HAL_SIM
+#include "hal_sim.h"
+#endif
+
+// Riddle gate: filtered reading (0..255 scale) must stay in the window this long
+#define GATE_LO       100
+#define GATE_HI       102
+#define GATE_HOLD_MS  2000
+
+// ADC telemetry every 50 bursts of 8 conversions at 250 us: 10 per second
+#define ADC_TLM_BURSTS 50
+
+#ifndef HAL_SIM
+// Clock settings are mirrored by HAL_PLL_* / HAL_PB_DIV in hal.h
 #pragma config JTAGEN = OFF
 #pragma config FWDTEN = OFF
 #pragma config FNOSC = FRCPLL
@@ -14,862 +44,576 @@
 #pragma config FPLLIDIV = DIV_2
 #pragma config FPLLMUL = MUL_20
 #pragma config FPLLODIV = DIV_1
+#endif
 
-#define LCD_CLEAR 0x01
-#define LCD_LINE1 0x80
-#define LCD_LINE2 0xC0
-
-// RGB LED effect variables
-volatile int green_blink_active = 0;
-volatile int red_blink_active = 0;
-volatile int red_blink_count = 0;
-
-// Seven-segment display variables
-volatile int ssd_digit = 0;
-volatile int coin_display_value = 0;
-unsigned char ssd_segments[16] = {
-    0x3F, // 0
-    0x06, // 1
-    0x5B, // 2
-    0x4F, // 3
-    0x66, // 4
-    0x6D, // 5
-    0x7D, // 6
-    0x07, // 7
-    0x7F, // 8
-    0x6F, // 9
-
+// Sound effects: { Hz, ms, duty % }, Hz 0 rests, ms 0 ends
+static const struct note snd_coin[] = { { 1319, 50, 25 }, { 1760, 90, 25 }, { 0, 0, 0 } };
+static const struct note snd_bomb[] = { { 392, 80, 50 }, { 262, 80, 50 }, { 165, 240, 50 }, { 0, 120, 0 }, { 0, 0, 0 } };
+static const struct note snd_game_over[] = {
+    { 523, 150, 30 }, { 392, 150, 30 }, { 330, 150, 30 }, { 262, 400, 30 }, { 0, 0, 0 }
 };
+static const struct note snd_menu[] = { { 880, 30, 20 }, { 0, 0, 0 } };
+
+_Static_assert(GAME_SUBSTEPS == SCROLL_SUBSTEPS, "one frame per scrolled pixel");
+
+// The per-frame CGRAM budget must drain well inside the shortest frame
+_Static_assert((uint64_t)SCROLL_CGRAM_BUDGET * T5_TICK_US * GAME_RATE_HARD * SCROLL_SUBSTEPS < 1000000000ull / 2,
+               "scroll CGRAM budget exceeds half a Hard frame");
+
+// Sprites: player per purchasable character, one per playfield entity type (scrolled)
+static const enum glyph_id character_glyph[3] = { GLYPH_HANDS_DOWN, GLYPH_HANDS_UP, GLYPH_DOG };
+static const enum glyph_id entity_glyph[PF_TYPES] = { GLYPH_COIN, GLYPH_BOMB };
+
 
-void lcd_cmd(unsigned char cmd);
-void lcd_data(unsigned char data);
-void init_lcd(void);
-void lcd_write_str(const char *str);
-void delay_ms(int ms);
-void busy(void);
-void ADC_Init(void);
-unsigned int ADC_AnalogRead(unsigned char analogPIN);
 void setup_pins();
-int scan_keypad();
-void load_custom_char_hands_down(void);
-void load_custom_char_hands_up(void);
-void load_custom_char_dog(void);
-void load_custom_char_coin(void);
-void load_custom_char_bomb(void);
-void buzz_soft_beep(void);
-void delay_us(unsigned int us);
-void init_RGB_LED();
 void init_timer5(void);
-void trigger_green_blink(void);
-void trigger_red_blink(void);
-void init_ssd(void);
-void display_coins(int coin_count);
 
-// Timer5 ISR for RGB LED effects and Seven-segment display
+// Timer5 ISR: LCD queue, inputs, sound, software timers and seven-segment display
 void __ISR(_TIMER_5_VECTOR, ipl4auto) Timer5ISR(void)
 {
-    static int green_timer_count = 0;
-    static int red_timer_count = 0;
-    static int led_timer_count = 0;
+    idle_wake();
+    PROF_ENTER(PROF_T5_ISR);
+    tb_tick();
+    idle_tick();
     
-    // LED effects (run at slower rate)
-    led_timer_count++;
-    if (led_timer_count >= 100) {  // Every 200ms for LED effects
-        if (green_blink_active) {
-            green_timer_count++;
-            if (green_timer_count >= 3) {  // 3 x 200ms = 600ms (about half second)
-                LATDbits.LATD12 = 0;       // Turn off green (RD12)
-                green_blink_active = 0;
-                green_timer_count = 0;
-            }
-        }
-        
-        if (red_blink_active) {
-            red_timer_count++;
-            if (red_timer_count >= 1) {    // 200ms intervals for fast but visible blinks
-                LATDbits.LATD2 ^= 1;       // Toggle red (RD2)
-                red_blink_count++;
-                red_timer_count = 0;
-                
-                if (red_blink_count >= 6) {  // 3 complete blinks (6 toggles)
-                    LATDbits.LATD2 = 0;      // Turn off red (RD2)
-                    red_blink_active = 0;
-                    red_blink_count = 0;
-                }
-            }
-        }
-        led_timer_count = 0;
-    }
+    // Feed the LCD one queued transfer once it reports not busy
+    PROF_ENTER(PROF_LCD_SERVICE);
+    lcd_service();
+    PROF_LEAVE(PROF_LCD_SERVICE);
     
-    // Seven-segment display multiplexing (every 2ms for smooth display)
-    // Turn off all digits first
-    LATBbits.LATB12 = 1;  // AN0
-    LATBbits.LATB13 = 1;  // AN1
-    LATAbits.LATA9 = 1;   // AN2
-    LATAbits.LATA10 = 1;  // AN3
+    // Keypad: one matrix row per tick while a key is down
+    PROF_ENTER(PROF_KEYPAD);
+    keypad_tick();
+    PROF_LEAVE(PROF_KEYPAD);
     
-    // Extract digits from coin_display_value
-    int thousands = (coin_display_value / 1000) % 10;
-    int hundreds = (coin_display_value / 100) % 10;
-    int tens = (coin_display_value / 10) % 10;
-    int ones = coin_display_value % 10;
+    // Slide switches: end debounce lockouts
+    sw_tick();
     
-    // Display current digit
-    switch(ssd_digit) {
-        case 0:  // Display thousands (leftmost digit)
-            // Set cathode segments for thousands digit
-            LATGbits.LATG12 = !(ssd_segments[thousands] & 0x01);  // CA
-            LATAbits.LATA14 = !(ssd_segments[thousands] & 0x02);  // CB
-            LATDbits.LATD6 = !(ssd_segments[thousands] & 0x04);   // CC
-            LATGbits.LATG13 = !(ssd_segments[thousands] & 0x08);  // CD
-            LATGbits.LATG15 = !(ssd_segments[thousands] & 0x10);  // CE
-            LATDbits.LATD7 = !(ssd_segments[thousands] & 0x20);   // CF
-            LATDbits.LATD13 = !(ssd_segments[thousands] & 0x40);  // CG
-            LATAbits.LATA10 = 0;  // Enable AN3 (leftmost)
-            break;
-        case 1:  // Display hundreds
-            LATGbits.LATG12 = !(ssd_segments[hundreds] & 0x01);
-            LATAbits.LATA14 = !(ssd_segments[hundreds] & 0x02);
-            LATDbits.LATD6 = !(ssd_segments[hundreds] & 0x04);
-            LATGbits.LATG13 = !(ssd_segments[hundreds] & 0x08);
-            LATGbits.LATG15 = !(ssd_segments[hundreds] & 0x10);
-            LATDbits.LATD7 = !(ssd_segments[hundreds] & 0x20);
-            LATDbits.LATD13 = !(ssd_segments[hundreds] & 0x40);
-            LATAbits.LATA9 = 0;   // Enable AN2
-            break;
-        case 2:  // Display tens
-            LATGbits.LATG12 = !(ssd_segments[tens] & 0x01);
-            LATAbits.LATA14 = !(ssd_segments[tens] & 0x02);
-            LATDbits.LATD6 = !(ssd_segments[tens] & 0x04);
-            LATGbits.LATG13 = !(ssd_segments[tens] & 0x08);
-            LATGbits.LATG15 = !(ssd_segments[tens] & 0x10);
-            LATDbits.LATD7 = !(ssd_segments[tens] & 0x20);
-            LATDbits.LATD13 = !(ssd_segments[tens] & 0x40);
-            LATBbits.LATB13 = 0;  // Enable AN1
-            break;
-        case 3:  // Display ones (rightmost digit)
-            LATGbits.LATG12 = !(ssd_segments[ones] & 0x01);
-            LATAbits.LATA14 = !(ssd_segments[ones] & 0x02);
-            LATDbits.LATD6 = !(ssd_segments[ones] & 0x04);
-            LATGbits.LATG13 = !(ssd_segments[ones] & 0x08);
-            LATGbits.LATG15 = !(ssd_segments[ones] & 0x10);
-            LATDbits.LATD7 = !(ssd_segments[ones] & 0x20);
-            LATDbits.LATD13 = !(ssd_segments[ones] & 0x40);
-            LATBbits.LATB12 = 0;  // Enable AN0 (rightmost)
-            break;
-    }
+    // Buzzer note sequencer
+    PROF_ENTER(PROF_SOUND);
+    sound_tick();
+    PROF_LEAVE(PROF_SOUND);
+    
+    // Hand queued telemetry frames to the UART
+    PROF_ENTER(PROF_TELEMETRY);
+    telemetry_service();
+    PROF_LEAVE(PROF_TELEMETRY);
+    
+    // Software timers: RGB LED effect steps
+    PROF_ENTER(PROF_TIMERS);
+    tw_tick();
+    PROF_LEAVE(PROF_TIMERS);
     
-    ssd_digit = (ssd_digit + 1) % 4;
+#if !SSD_USE_DMA
+    // Seven-segment display multiplexing (every tick for smooth display)
+    ssd_refresh();
+#endif
     
-    IFS0bits.T5IF = 0;
+    hal_timer5_ack();
+    PROF_LEAVE(PROF_T5_ISR);
+}
+
+// A column went LOW while the keypad was idle (start the scan), or a slide
+// switch moved
+void __ISR(_CHANGE_NOTICE_VECTOR, ipl4auto) ChangeNoticeISR(void)
+{
+    idle_wake();
+    PROF_ENTER(PROF_CN_ISR);
+    if (hal_cn_flagged(HAL_PORT_C) || hal_cn_flagged(HAL_PORT_G))
+        keypad_change();
+    if (hal_cn_flagged(HAL_PORT_D) || hal_cn_flagged(HAL_PORT_F))
+        sw_change();
+    PROF_LEAVE(PROF_CN_ISR);
+}
+
+// Eight fresh conversions of AN2 are waiting in the ADC buffer
+void __ISR(_ADC_VECTOR, ipl3auto) ADCISR(void)
+{
+    static unsigned int bursts = 0;
+    
+    idle_wake();
+    PROF_ENTER(PROF_ADC_ISR);
+    adc_isr();
+    if (++bursts >= ADC_TLM_BURSTS) {
+        bursts = 0;
+        telemetry_adc(adc_raw(), adc_value());
+    }
+    PROF_LEAVE(PROF_ADC_ISR);
 }
 
 void setup_pins() {
     // Configure keypad row pins as OUTPUTS
-    TRISCbits.TRISC2 = 0; // x0 - RC2 is output
-    TRISCbits.TRISC1 = 0; // x1 - RC1 is output
-    TRISCbits.TRISC4 = 0; // x2 - RC4 is output
-    TRISGbits.TRISG6 = 0; // x3 - RG6 is output
+    hal_output(PIN_KEY_ROW1); // x0 - RC2 is output
+    hal_output(PIN_KEY_ROW2); // x1 - RC1 is output
+    hal_output(PIN_KEY_ROW3); // x2 - RC4 is output
+    hal_output(PIN_KEY_ROW4); // x3 - RG6 is output
     
     // Initially set all rows HIGH
-    LATCbits.LATC2 = 1;
-    LATCbits.LATC1 = 1;
-    LATCbits.LATC4 = 1;
-    LATGbits.LATG6 = 1;
+    hal_set(PIN_KEY_ROW1);
+    hal_set(PIN_KEY_ROW2);
+    hal_set(PIN_KEY_ROW3);
+    hal_set(PIN_KEY_ROW4);
 
     // Configure keypad column pins as INPUTS with pull-ups
-    TRISCbits.TRISC3 = 1;  // y0 - RC3 is input
-    CNPUCbits.CNPUC3 = 1;  // Enable pull-up for RC3
+    hal_input(PIN_KEY_COL1);  // y0 - RC3 is input
+    hal_pullup(PIN_KEY_COL1); // Enable pull-up for RC3
 
-    TRISGbits.TRISG7 = 1;  // y1 - RG7 is input
-    CNPUGbits.CNPUG7 = 1;  // Enable pull-up for RG7
+    hal_input(PIN_KEY_COL2);  // y1 - RG7 is input
+    hal_pullup(PIN_KEY_COL2); // Enable pull-up for RG7
 
-    TRISGbits.TRISG8 = 1;  // y2 - RG8 is input
-    CNPUGbits.CNPUG8 = 1;  // Enable pull-up for RG8
+    hal_input(PIN_KEY_COL3);  // y2 - RG8 is input
+    hal_pullup(PIN_KEY_COL3); // Enable pull-up for RG8
 
-    TRISGbits.TRISG9 = 1;  // y3 - RG9 is input
-    CNPUGbits.CNPUG9 = 1;  // Enable pull-up for RG9
+    hal_input(PIN_KEY_COL4);  // y3 - RG9 is input
+    hal_pullup(PIN_KEY_COL4); // Enable pull-up for RG9
 
     
-    ANSELGbits.ANSG6 = 0;  
-    ANSELGbits.ANSG7 = 0;  
-    ANSELGbits.ANSG8 = 0;  
-    ANSELGbits.ANSG9 = 0;  
+    hal_digital(HAL_PORT_G, (1u << 6) | (1u << 7) | (1u << 8) | (1u << 9));
     
-    TRISBbits.TRISB15 = 0; // RS
-    TRISDbits.TRISD5 = 0;  // RW
-    TRISDbits.TRISD4 = 0;  // EN
-    TRISE = 0x00; // Data bus (all pins as output)
-    ANSELE = 0x00;
-    ANSELBbits.ANSB15 = 0;
+    hal_output(PIN_LCD_RS);
+    hal_output(PIN_LCD_RW);
+    hal_output(PIN_LCD_EN);
+    hal_output(PORT_LCD_DATA, 0xFF); // Data bus (all pins as output)
+    hal_digital(PORT_LCD_DATA, 0xFF);
+    hal_digital(PIN_LCD_RS);
     
-    TRISBbits.TRISB14 = 0;
-    ANSELBbits.ANSB14 = 0;
+    hal_output(PIN_BUZZER);
+    hal_digital(PIN_BUZZER);
 
     
-    
-    ANSELEbits.ANSE2 = 0;
-    ANSELEbits.ANSE4 = 0;
-    ANSELEbits.ANSE5 = 0;
-    ANSELEbits.ANSE6 = 0;
-    
-    TRISA &= 0XFF00;
-    TRISFbits.TRISF3 = 1; // SW0 (RF3) for HEX counter mode
-    TRISFbits.TRISF5 = 1; // SW1 (RF5) for SHIFT mode
-    TRISFbits.TRISF4 = 1; // SW2 (RF4) for Fan mode
-    TRISDbits.TRISD15 = 1; // SW3 (D15) for reverse mode
+    hal_output(PORT_LEDS, 0x00FF);
+    hal_input(PIN_SW0); // SW0 (RF3) for HEX counter mode
+    hal_input(PIN_SW1); // SW1 (RF5) for SHIFT mode
+    hal_input(PIN_SW2); // SW2 (RF4) for Fan mode
+    hal_input(PIN_SW3); // SW3 (D15) for reverse mode
     
     
 
 }
 
-void init_RGB_LED(void)
+void init_timer5(void)
 {
-    TRISDbits.TRISD2 = 0;   // Red LED
-    TRISDbits.TRISD12 = 0;  // Green LED
-    
-    LATDbits.LATD2 = 0;     // Initially off
-    LATDbits.LATD12 = 0;    // Initially off
+    // 1:16 prescaler, 250 us tick for smooth seven-segment display
+    hal_timer5_init(T5_TCKPS, T5_PR, 4);
 }
 
-void init_timer5(void)
+// === Game state ===
+enum {
+    ST_RIDDLE,
+    ST_CORRECT,
+    ST_MENU,
+    ST_DIFFICULTY,
+    ST_MODE,
+    ST_GAME,
+    ST_GAME_OVER,
+    ST_STORE,
+    ST_STORE_DONE,
+    ST_BYE,
+    ST_COUNT
+};
+
+// Mirrors of the persistent state, loaded from nvstore in main()
+static int coins = 10;
+static int character = 0;
+static uint32_t owned = 1;         // bit n: character n bought
+static int speed;
+static int accept_keys;
+static uint32_t store_linger;
+
+static struct game play;
+static unsigned char ch;
+static uint32_t stats_sent;        // last TLM_FRAME during play
+
+// Riddle: LEDs follow the filtered ADC, the hold timer runs while inside the window
+static void riddle_enter(void)
 {
-    T5CONbits.ON = 0;
-    T5CONbits.TGATE = 0;
-    T5CONbits.TCS = 0;
-    T5CONbits.TCKPS0 = 1;
-    T5CONbits.TCKPS1 = 1;
-    T5CONbits.TCKPS2 = 0;  // 1:16 prescaler for faster display refresh
-    
-    TMR5 = 0;
-    PR5 = 1250;  // ~2ms intervals for smooth seven-segment display
-    
-    IPC5bits.T5IP = 4;
-    IPC5bits.T5IS = 0;
-    IFS0bits.T5IF = 0;
-    IEC0bits.T5IE = 1;
-    
-    T5CONbits.ON = 1;
+    lcd_fb_show("Answer the hint", "101 in binary is");
+    fsm_adc_window(GATE_LO << (ADC_BITS - 8), ((GATE_HI + 1) << (ADC_BITS - 8)) - 1);
+    fsm_frames(50000);   // 20 ms
 }
 
-void trigger_green_blink(void)
+static void riddle_tick(void)
 {
-    LATDbits.LATD12 = 1;     // Turn on green (RD12 is green)
-    green_blink_active = 1;  // Will be turned off by timer
+    unsigned int display_val = fsm_input_adc() >> (ADC_BITS - 8);
+
+    // LEDs are RA0..RA7 only; RA9/RA10/RA14 belong to the seven-segment display
+    hal_clr(PORT_LEDS, 0xFF & ~display_val);
+    hal_set(PORT_LEDS, 0xFF & display_val);
 }
 
-void trigger_red_blink(void)
+static void riddle_event(const struct fsm_event *ev)
 {
-    LATDbits.LATD2 = 1;      // Turn on red (RD2 is red)
-    red_blink_active = 1;    // Will blink 3 times via timer
-    red_blink_count = 0;
+    if (ev->type == FSM_EV_ADC && ev->arg)
+        fsm_timer(GATE_HOLD_MS);
+    else if (ev->type == FSM_EV_ADC)
+        fsm_timer_cancel();
+    else if (ev->type == FSM_EV_TIMER)
+        fsm_goto(ST_CORRECT);
 }
 
-char scan_key[] = {
-    0x44, '1',  0x34, '2',  0x24, '3',  0x14, 'A',
-    0x43, '4',  0x33, '5',  0x23, '6',  0x13, 'B',
-    0x42, '7',  0x32, '8',  0x22, '9',  0x12, 'C',
-    0x41, '0',  0x31, 'F',  0x21, 'E',  0x11, 'D'
-};
+static void correct_enter(void)
+{
+    lcd_fb_show("Correct!", "");
+    fsm_timer(3000);
+}
 
+static void correct_exit(void)
+{
+    hal_clr(PORT_LEDS, 0xFF);
+}
 
-int scan_keypad() {
-    int row, col;
-    int flag = 0;
+static void menu_enter(void)
+{
+    lcd_fb_show("MENU:   Play-1", "Exit-2  Store-3 ");
+    display_coins(coins);
+}
 
-    // Row 1
-    LATCbits.LATC2 = 0; // Activate row 1 (set LOW)
-    delay_ms(1); // Short delay for signal to stabilize
-    
-    if (!PORTCbits.RC3) { col = 1; row = 1; flag = 1; }
-    else if (!PORTGbits.RG7) { col = 2; row = 1; flag = 1; }
-    else if (!PORTGbits.RG8) { col = 3; row = 1; flag = 1; }
-    else if (!PORTGbits.RG9) { col = 4; row = 1; flag = 1; }
-    
-    LATCbits.LATC2 = 1; // Deactivate row (set HIGH)
-
-    // Row 2
-    if (!flag) {
-        LATCbits.LATC1 = 0; // Activate row 2
-        delay_ms(1);
-        
-        if (!PORTCbits.RC3) { col = 1; row = 2; flag = 1; }
-        else if (!PORTGbits.RG7) { col = 2; row = 2; flag = 1; }
-        else if (!PORTGbits.RG8) { col = 3; row = 2; flag = 1; }
-        else if (!PORTGbits.RG9) { col = 4; row = 2; flag = 1; }
-        
-        LATCbits.LATC1 = 1; // Deactivate row
-    }
+static void menu_event(const struct fsm_event *ev)
+{
+    if (ev->type != FSM_EV_KEY)
+        return;
+    if (ev->arg == 0x44)
+        fsm_goto(ST_DIFFICULTY);
+    else if (ev->arg == 0x34)
+        fsm_goto(ST_BYE);
+    else if (ev->arg == 0x24)
+        fsm_goto(ST_STORE);
+    else
+        return;
+    sound_play(snd_menu);
+}
 
-    // Row 3
-    if (!flag) {
-        LATCbits.LATC4 = 0; // Activate row 3
-        delay_ms(1);
-        
-        if (!PORTCbits.RC3) { col = 1; row = 3; flag = 1; }
-        else if (!PORTGbits.RG7) { col = 2; row = 3; flag = 1; }
-        else if (!PORTGbits.RG8) { col = 3; row = 3; flag = 1; }
-        else if (!PORTGbits.RG9) { col = 4; row = 3; flag = 1; }
-        
-        LATCbits.LATC4 = 1; // Deactivate row
-    }
+// Keys pressed during the first second are ignored
+static void difficulty_enter(void)
+{
+    lcd_fb_show("Easy press - 1", "Hard press - 2");
+    accept_keys = 0;
+    fsm_timer(1000);
+}
 
-    // Row 4
-    if (!flag) {
-        LATGbits.LATG6 = 0; // Activate row 4
-        delay_ms(1);
-        
-        if (!PORTCbits.RC3) { col = 1; row = 4; flag = 1; }
-        else if (!PORTGbits.RG7) { col = 2; row = 4; flag = 1; }
-        else if (!PORTGbits.RG8) { col = 3; row = 4; flag = 1; }
-        else if (!PORTGbits.RG9) { col = 4; row = 4; flag = 1; }
-        
-        LATGbits.LATG6 = 1; // Deactivate row
-    }
-    
-    if (!flag) return 0; // No key detected
-    
-    else{ // key Detected
-        
-        // Wait for key release (debounce)
-        while (!PORTCbits.RC3 || !PORTGbits.RG7 || !PORTGbits.RG8 || !PORTGbits.RG9) {
-            delay_ms(10); // Check every 10ms
-        }
-        
-        delay_ms(50); // Additional debounce time after release
-        
-        return (row << 4)|col;
+static void difficulty_event(const struct fsm_event *ev)
+{
+    if (ev->type == FSM_EV_TIMER) {
+        accept_keys = 1;
+    } else if (ev->type == FSM_EV_KEY && accept_keys && (ev->arg == 0x44 || ev->arg == 0x34)) {
+        speed = ev->arg == 0x34;
+        fsm_goto(ST_MODE);
     }
 }
 
-void main(void)
+static void mode_enter(void)
 {
-    unsigned int adc_val, display_val;
-    int correct_counter = 0;
+    lcd_fb_show(speed ? "Hard mode selected" : "Easy mode selected", "");
+    sound_play(snd_menu);
+    fsm_timer(2000);
+}
 
-    TRISBbits.TRISB14 = 0;
-    ANSELBbits.ANSB14 = 0;
-    TRISBbits.TRISB15 = 0; // RS
-    TRISDbits.TRISD5  = 0; // RW
-    TRISDbits.TRISD4  = 0; // EN
-    TRISE = 0x00;
-    ANSELE = 0x00;
-    ANSELBbits.ANSB15 = 0;
+static void game_render(void)
+{
+    PROF_ENTER(PROF_RENDER);
+    scroll_render(&play.pf, entity_glyph, play.sub);
+    lcd_fb_put_char(play.player_row, play.player_col, ch);
+    lcd_fb_flush();  // Unchanged cells cost nothing
+    PROF_LEAVE(PROF_RENDER);
+}
 
-    TRISBbits.TRISB2 = 1;
-    ANSELBbits.ANSB2 = 1;
-    TRISA &= 0xFF00;
-    LATA = 0;
+static void game_enter(void)
+{
+    nvs_hold(1);   // no flash stalls mid-run, coins are flushed afterwards
+    game_start(&play, speed, fsm_input_sw0());
+    display_coins(coins);
 
-    TRISFbits.TRISF3 = 1; // SW0
+    // Resident sprites cost nothing; misses queue their CGRAM upload
+    ch = glyph_slot(character_glyph[character]);
 
-    init_lcd();
-    ADC_Init();
-    setup_pins();
-    init_RGB_LED();
-    init_ssd();
-    init_timer5();
-    
-    // Enable interrupts
-    INTCONbits.MVEC = 1;
-    asm("ei");
-   
-    lcd_cmd(LCD_CLEAR);
-    lcd_cmd(LCD_LINE1);
-    lcd_write_str("Answer the hint");
-    lcd_cmd(LCD_LINE2);
-    lcd_write_str("101 in binary is");
-
-    while (1)
-    {
-        adc_val = ADC_AnalogRead(2);
-        display_val = adc_val / 4;
-        PORTA = display_val;
-
-        if (display_val >= 100 && display_val <= 102)
-            correct_counter++;
-        else
-            correct_counter = 0;
-
-        if (correct_counter >= 20)
-        {
-            lcd_cmd(LCD_CLEAR);
-            lcd_cmd(LCD_LINE1);
-            lcd_write_str("Correct!");
-            break;
-        }
-
-        delay_ms(100);
-    }
+    scroll_reset();
+    game_render();
+    stats_sent = tb_ticks();
 
-    delay_ms(3000);
-    int exitGame = 1;
-    int character = 0;
-    int coins = 10;
-    int speed;
-    PORTA = 0;
-    while(exitGame){
-        int gameOver = 1;
-        int key = 0;
-        
-        // Initialize display for menu
-        display_coins(coins);
-        
-        while(key != 0x34 && key != 0x44 && key != 0x24 ){
-            lcd_cmd(LCD_CLEAR);
-            lcd_cmd(LCD_LINE1);
-            lcd_write_str("MENU:   Play-1");
-            lcd_cmd(LCD_LINE2);
-            lcd_write_str("Exit-2  Store-3 ");
-            
-            // Keep display updated during menu
-            display_coins(coins);
-            delay_ms(50);  // Short delay to reduce LCD refresh rate
-            
-            key = scan_keypad();
-        }
-        if (key == 0x44){
-            key = 0;
-            lcd_cmd(LCD_CLEAR);
-            lcd_cmd(LCD_LINE1);
-            lcd_write_str("Easy press - 1");
-            lcd_cmd(LCD_LINE2);
-            lcd_write_str("Hard press - 2");
-            delay_ms(1000);
-            while (1)
-            {
-                key = scan_keypad();
-                if (key == 0x44)
-                {
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_cmd(LCD_LINE1);
-                    lcd_write_str("Easy mode selected");
-                    speed = 0;
-                    break;
-                }
-                else if (key == 0x34)
-                {
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_cmd(LCD_LINE1);
-                    lcd_write_str("Hard mode selected");
-                    speed = 1;
-                    break;
-                }
-                delay_ms(100);
-            }
-
-            delay_ms(2000);
-            int Score = 0;
-            int prevSW0 = 0;
-            int currentSW0 = 0;
-            unsigned char player_row = 0xC0;
-            unsigned char player_col = 0;
-            unsigned char coin_col = 15;
-            unsigned char coin_row = 0x80;
-            unsigned char bomb_col = 10;
-            unsigned char bomb_row = 0xC0;
-            int toggle = 0;
-            int bomb_toggle = 1;
-            int ch;
-
-            // Initialize coin display
-            display_coins(coins);
-
-            if(character == 0){ load_custom_char_hands_down(); ch = 0; }
-            else if(character == 1){ load_custom_char_hands_up(); ch = 1; }
-            else if(character == 2){ load_custom_char_dog(); ch = 2; }
-
-            load_custom_char_coin();  
-            load_custom_char_bomb();  
-
-            lcd_cmd(player_row + player_col); lcd_data(ch);
-            lcd_cmd(coin_row + coin_col);     lcd_data(3);
-            lcd_cmd(bomb_row + bomb_col);     lcd_data(4);
-
-            while (gameOver)
-            {
-                    currentSW0 = PORTFbits.RF3;
-
-                    if (currentSW0 && !prevSW0) {
-                        player_row = 0x80;
-                    } else if (!currentSW0 && prevSW0) {
-                        player_row = 0xC0;
-                    }
-                    prevSW0 = currentSW0;
-
-                    lcd_cmd(coin_row + coin_col); lcd_data(' ');
-                    lcd_cmd(bomb_row + bomb_col); lcd_data(' ');
-                    lcd_cmd(player_row == 0x80 ? 0xC0 : 0x80); lcd_cmd(player_col); lcd_data(' ');
-
-                    if (coin_col > 0) {
-                        coin_col--;
-                    } else {
-                        coin_col = 15;
-                        if (toggle == 0) { coin_row = 0x80; toggle = 1; }
-                        else { coin_row = 0xC0; toggle = 0; }
-                    }
-
-                    if (bomb_col > 0) {
-                        bomb_col--;
-                    } else {
-                        bomb_col = 15;
-                        if (bomb_toggle == 0) { bomb_row = 0xC0; bomb_toggle = 1; }
-                        else { bomb_row = 0x80; bomb_toggle = 0; }
-                    }
-
-                    
-                    lcd_cmd(player_row + player_col); lcd_data(ch);
-                    lcd_cmd(coin_row + coin_col);     lcd_data(3);
-                    lcd_cmd(bomb_row + bomb_col);     lcd_data(4);
-
-                    
-                    if (coin_col == player_col && coin_row == player_row) {
-                        coins++;
-                        display_coins(coins);  // Update seven-segment display
-                        buzz_soft_beep();
-                        trigger_green_blink();  // Trigger green blink for coin collection
-                    }
-
-                    
-                    if (bomb_col == player_col && bomb_row == player_row) {
-                        buzz_soft_beep();
-                        trigger_red_blink();    // Trigger red triple blink for bomb hit
-                        lcd_cmd(LCD_CLEAR);
-                        lcd_write_str("BOOM! Game Over");
-                        delay_ms(2000);
-                        gameOver = 0;
-                        break;
-                    }
-
-                    if(speed == 1){
-                        delay_ms(180);
-                    }
-                    else{
-                        delay_ms(400);
-                    }
-            }
-
-        }
-        else if (key == 0x34){
-            exitGame = 0;
-            lcd_cmd(LCD_CLEAR);
-            lcd_cmd(LCD_LINE1);
-            lcd_write_str("Good_Bye ");
-            delay_ms(2000);
-        }
-        else if(key == 0x24){
-            lcd_cmd(LCD_CLEAR);
-            
-            key = 0;
-
-            load_custom_char_hands_down(); // 0 
-            load_custom_char_hands_up();   // 1
-            load_custom_char_dog();        // 2
-
-            lcd_cmd(LCD_LINE1 + 0);
-            lcd_write_str("0C");
-
-            lcd_cmd(LCD_LINE1 + 6);
-            lcd_write_str("5C");
-
-            lcd_cmd(LCD_LINE1 + 12);
-            lcd_write_str("4C");
-
-            lcd_cmd(0xC0 + 0);
-            lcd_data(0);
-
-            lcd_cmd(0xC0 + 6);
-            lcd_data(1);
-
-            lcd_cmd(0xC0 + 12);
-            lcd_data(2);
-
-            while(1)
-            {
-                // Keep display stable during store browsing
-                display_coins(coins);
-                delay_ms(10);
-                
-                key = scan_keypad();
-                if(key == 0x42 && coins >= 2){
-                    character = 0;
-                    display_coins(coins);  // Update display immediately
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_write_str("chosen Char 1!");
-                    break;
-                } else if(key == 0x43 && coins >= 5){
-                    coins -= 5;
-                    display_coins(coins);  // Update display immediately after purchase
-                    character = 1;
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_write_str("Bought Char 2!");
-                    break;
-                } else if(key == 0x44 && coins >= 4){
-                    coins -= 4;
-                    display_coins(coins);  // Update display immediately after purchase
-                    character = 2;
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_write_str("Bought Char 3!");
-                    break;
-                } else if(key == 0x44 || key == 0x43 || key == 0x42){
-                    lcd_cmd(LCD_CLEAR);
-                    lcd_write_str("Not enough coins");
-                    delay_ms(1500);
-                    break;
-                }
-            }
-            delay_ms(2000);
-        }
-    }
+    // One frame per pixel: GAME_SUBSTEPS frames per playfield step
+    fsm_frames(game_frame_mhz(speed));
 }
 
-void load_custom_char_bomb(void)
+static void game_tick(void)
 {
-    unsigned char bomb[8] = {
-        0x04,
-        0x0A,
-        0x15,
-        0x0E,
-        0x0E,
-        0x1F,
-        0x04,
-        0x0A
-    };
-
-    lcd_cmd(0x50 + 16);
-    for (int i = 0; i < 8; i++) {
-        lcd_data(bomb[i]);
+    unsigned int ev;
+
+    // Drawn before the collision test, so a taken coin vanishes next frame
+    game_advance(&play);
+    game_render();
+
+    ev = game_collide(&play);
+    if (ev & GAME_EV_COIN) {
+        coins++;
+        nvs_set(NVS_COINS, coins);
+        display_coins(coins);  // Update seven-segment display
+        sound_play(snd_coin);
+        rgb_play(RGB_SEQ_COIN);
+        telemetry_score(TLM_SCORE_COIN, coins, play.player_row);
     }
-}
 
-void load_custom_char_dog(void)
-{
-    unsigned char dog[8] = {
-        0x00,
-        0x0A,
-        0x1F,
-        0x15,
-        0x1F,
-        0x04,
-        0x0A,
-        0x11
-    };
-
-    lcd_cmd(0x50);
-    for (int i = 0; i < 8; i++) {
-        lcd_data(dog[i]);
+    if (ev & GAME_EV_BOMB) {
+        sound_play(snd_bomb);
+        sound_play(snd_game_over);
+        rgb_play(RGB_SEQ_BOMB);
+        telemetry_score(TLM_SCORE_BOMB, coins, play.player_row);
+        fsm_goto(ST_GAME_OVER);
     }
-}
 
-void load_custom_char_coin(void) {
-    unsigned char coin[8] = {
-        0b00000,
-        0b00110,
-        0b01111,
-        0b01111,
-        0b01111,
-        0b01111,
-        0b00110,
-        0b00000
-    };
-    
-    lcd_cmd(0x50 + 8);
-    for (int i = 0; i < 8; i++) {
-        lcd_data(coin[i]);
+    if (tb_elapsed(stats_sent, TB_TICKS_PER_MS * 1000)) {
+        stats_sent = tb_ticks();
+        telemetry_frame(fsm_frame_clock());
     }
 }
 
-void load_custom_char_hands_down(void)
+static void game_exit(void)
 {
-    unsigned char man[8] = {
-        0x0E,
-        0x0E,
-        0x04,
-        0x04,
-        0x0E,
-        0x15,
-        0x04,
-        0x0A
-    };
-
-    lcd_cmd(0x40); 
-    for (int i = 0; i < 8; i++) {
-        lcd_data(man[i]);
-    }
+    nvs_hold(0);
 }
 
-void load_custom_char_hands_up(void)
+// SW0 up: top row, down: bottom row. Drawn at once rather than on the next
+// frame: the repeated scroll_render() queues nothing, only the player moves.
+static void game_event(const struct fsm_event *ev)
 {
-    unsigned char man[8] = {
-        0x0E,   
-        0x04,    
-        0x15,   
-        0x0E,   
-        0x04, 
-        0x04,  
-        0x0A,    
-        0x11      
-    };
-
-    lcd_cmd(0x40 + 8);
-    for (int i = 0; i < 8; i++) {
-        lcd_data(man[i]);
-    }
+    uint32_t stamp;
+
+    if (ev->type != FSM_EV_SW0)
+        return;
+    game_move(&play, ev->arg);
+    game_render();
+    if (fsm_input_sw0_stamp(&stamp))
+        sw_rendered(stamp);
 }
 
-void buzz_soft_beep(void)
+static void game_over_enter(void)
 {
-    for (int i = 0; i < 100; i++) {
-        PORTBbits.RB14 = 1;
-        delay_us(300); 
-        PORTBbits.RB14 = 0;
-        delay_us(300);
-    }
+    enum nvs_key best = speed ? NVS_BEST_HARD : NVS_BEST_EASY;
+    char line[17];
+    unsigned long shown;
+
+    if (play.coins > nvs_get(best))
+        nvs_set(best, play.coins);
+    shown = nvs_get(best);
+    if (shown > 999999)
+        shown = 999999;   // "Best run: " leaves 6 columns
+    snprintf(line, sizeof(line), "Best run: %lu", shown);
+
+    telemetry_frame(fsm_frame_clock());
+    lcd_fb_show("BOOM! Game Over", line);
+    fsm_timer(2000);
 }
 
-void delay_us(unsigned int us)
+static void store_enter(void)
 {
-    for (int i = 0; i < us; i++) {
-        for (volatile int j = 0; j < 2; j++); 
-        
-    }
+    lcd_fb_clear();
+    lcd_fb_put_str(0, 0, "0C");
+    lcd_fb_put_str(0, 6, "5C");
+    lcd_fb_put_str(0, 12, "4C");
+    lcd_fb_put_char(1, 0, glyph_slot(character_glyph[0]));
+    lcd_fb_put_char(1, 6, glyph_slot(character_glyph[1]));
+    lcd_fb_put_char(1, 12, glyph_slot(character_glyph[2]));
+    lcd_fb_flush();
 }
 
-void init_ssd(void)
+static void store_event(const struct fsm_event *ev)
 {
-    // Configure anode pins as outputs
-    TRISBbits.TRISB12 = 0;  // AN0
-    TRISBbits.TRISB13 = 0;  // AN1
-    TRISAbits.TRISA9 = 0;   // AN2
-    TRISAbits.TRISA10 = 0;  // AN3
-    
-    // Configure cathode pins as outputs
-    TRISGbits.TRISG12 = 0;  // CA
-    TRISAbits.TRISA14 = 0;  // CB
-    TRISDbits.TRISD6 = 0;   // CC
-    TRISGbits.TRISG13 = 0;  // CD
-    TRISGbits.TRISG15 = 0;  // CE
-    TRISDbits.TRISD7 = 0;   // CF
-    TRISDbits.TRISD13 = 0;  // CG
-    
-    // Disable analog functionality for AN0 and AN1
-    ANSELBbits.ANSB12 = 0;
-    ANSELBbits.ANSB13 = 0;
-    
-    // Initialize all digits off (anodes high)
-    LATBbits.LATB12 = 1;   // AN0
-    LATBbits.LATB13 = 1;   // AN1
-    LATAbits.LATA9 = 1;    // AN2
-    LATAbits.LATA10 = 1;   // AN3
-    
-    // Initialize all segments off (cathodes high for common anode)
-    LATGbits.LATG12 = 1;   // CA
-    LATAbits.LATA14 = 1;   // CB
-    LATDbits.LATD6 = 1;    // CC
-    LATGbits.LATG13 = 1;   // CD
-    LATGbits.LATG15 = 1;   // CE
-    LATDbits.LATD7 = 1;    // CF
-    LATDbits.LATD13 = 1;   // CG
+    uint32_t linger = 2000;
+
+    if (ev->type != FSM_EV_KEY)
+        return;
+    if (ev->arg == 0x42 && coins >= 2) {
+        character = 0;
+        lcd_fb_show("chosen Char 1!", "");
+    } else if (ev->arg == 0x43 && (owned & 2)) {
+        character = 1;
+        lcd_fb_show("chosen Char 2!", "");
+    } else if (ev->arg == 0x43 && coins >= 5) {
+        coins -= 5;
+        character = 1;
+        owned |= 2;
+        lcd_fb_show("Bought Char 2!", "");
+        rgb_play(RGB_SEQ_BUY);
+    } else if (ev->arg == 0x44 && (owned & 4)) {
+        character = 2;
+        lcd_fb_show("chosen Char 3!", "");
+    } else if (ev->arg == 0x44 && coins >= 4) {
+        coins -= 4;
+        character = 2;
+        owned |= 4;
+        lcd_fb_show("Bought Char 3!", "");
+        rgb_play(RGB_SEQ_BUY);
+    } else if (ev->arg == 0x44 || ev->arg == 0x43 || ev->arg == 0x42) {
+        lcd_fb_show("Not enough coins", "");
+        linger = 3500;
+    } else {
+        return;
+    }
+    display_coins(coins);  // Update display immediately after purchase
+    nvs_set(NVS_COINS, coins);
+    nvs_set(NVS_CHARACTER, character);
+    nvs_set(NVS_OWNED, owned);
+    store_linger = linger;
+    fsm_goto(ST_STORE_DONE);
 }
 
-void display_coins(int coin_count)
+static void store_done_enter(void)
 {
-    coin_display_value = coin_count;
+    fsm_timer(store_linger);
 }
 
-
-void init_lcd(void)
+static void bye_enter(void)
 {
-    lcd_cmd(0x38); 
-    lcd_cmd(0x0C); 
-    lcd_cmd(0x06); 
-    lcd_cmd(0x01); 
-    delay_ms(250);
+    lcd_fb_show("Good_Bye ", "");
 }
 
-void lcd_write_str(const char *str)
+// Timer expiry moves these states on
+static void to_menu(const struct fsm_event *ev)
 {
-    while (*str)
-        lcd_data(*str++);
+    if (ev->type == FSM_EV_TIMER)
+        fsm_goto(ST_MENU);
 }
 
-void lcd_cmd(unsigned char cmd)
+static void to_game(const struct fsm_event *ev)
 {
-    PORTBbits.RB15 = 0; // RS = 0
-    PORTDbits.RD5 = 0;  // RW = 0
-    PORTE = cmd;
-    PORTDbits.RD4 = 1;
-    PORTDbits.RD4 = 0;
-    busy();
+    if (ev->type == FSM_EV_TIMER)
+        fsm_goto(ST_GAME);
 }
 
-void lcd_data(unsigned char data)
+static const struct fsm_state states[ST_COUNT] = {
+    //                 name          enter             exit          tick         event
+    [ST_RIDDLE]     = { "riddle",     riddle_enter,     NULL,         riddle_tick, riddle_event },
+    [ST_CORRECT]    = { "correct",    correct_enter,    correct_exit, NULL,        to_menu },
+    [ST_MENU]       = { "menu",       menu_enter,       NULL,         NULL,        menu_event },
+    [ST_DIFFICULTY] = { "difficulty", difficulty_enter, NULL,         NULL,        difficulty_event },
+    [ST_MODE]       = { "mode",       mode_enter,       NULL,         NULL,        to_game },
+    [ST_GAME]       = { "game",       game_enter,       game_exit,    game_tick,   game_event },
+    [ST_GAME_OVER]  = { "game over",  game_over_enter,  NULL,         NULL,        to_menu },
+    [ST_STORE]      = { "store",      store_enter,      NULL,         NULL,        store_event },
+    [ST_STORE_DONE] = { "store done", store_done_enter, NULL,         NULL,        to_menu },
+    [ST_BYE]        = { "bye",        bye_enter,        NULL,         NULL,        NULL },
+};
+
+// Saved coins, characters and best runs; flushed from the dispatcher's idle time
+static void load_progress(void)
 {
-    PORTBbits.RB15 = 1; // RS = 1
-    PORTDbits.RD5 = 0;  // RW = 0
-    PORTE = data;
-    PORTDbits.RD4 = 1;
-    PORTDbits.RD4 = 0;
-    busy();
+    static const uint32_t defaults[NVS_KEYS] = { [NVS_COINS] = 10, [NVS_OWNED] = 1 };
+
+    nvs_init(defaults);
+    coins = (int)nvs_get(NVS_COINS);
+    owned = nvs_get(NVS_OWNED) | 1;
+    character = (int)nvs_get(NVS_CHARACTER);
+    if (character > 2 || !(owned & (1u << character)))
+        character = 0;
+    fsm_background(nvs_service);
 }
 
+#ifdef HAL_SIM
+// SIM_RECORD=file records the session's inputs, SIM_REPLAY=file plays one back
+#define SESSION_MAX 65536
+static unsigned char session[SESSION_MAX];
 
-
-void delay_ms(int ms)
+static void session_save(void)
 {
-    int i, j;
-    for (i = 0; i < ms; i++)
-        for (j = 0; j < 800; j++);
+    FILE *f = fopen(getenv("SIM_RECORD"), "wb");
+
+    replay_end(fsm_now());
+    if (!f)
+        return;
+    fwrite(session, 1, replay_length(), f);
+    fclose(f);
+    if (replay_length() == 0)
+        printf("replay: recording overflowed %d bytes, nothing saved\n", SESSION_MAX);
 }
 
-
-
-void busy(void)
+// On exit, ahead of the simulator's own report: the game-side statistics and
+// the profiler trace (to $SIM_DUMP)
+static void session_report(void)
 {
-    char RD, RS;
-    int STATUS_TRISE;
-    int portMap;
-
-    RD = PORTDbits.RD5;
-    RS = PORTBbits.RB15;
-    STATUS_TRISE = TRISE;
-    PORTDbits.RD5 = 1; // RW = 1
-    PORTBbits.RB15 = 0; // RS = 0
-    portMap = TRISE;
-    portMap |= 0x80; // RE7
-    TRISE = portMap;
-
-    do {
-        PORTDbits.RD4 = 1;
-        _asm_ volatile("nop");
-        PORTDbits.RD4 = 0;
-    } while (PORTEbits.RE7);
-
-    PORTDbits.RD5 = RD;
-    PORTBbits.RB15 = RS;
-    TRISE = STATUS_TRISE;
-}
-
-// === ADC ===
-void ADC_Init()
+    const struct frame_clock *f = fsm_frame_clock();
+
+    printf("frames: %lu, %lu overruns, work %lu/%lu/%lu cycles min/avg/max\n",
+           (unsigned long)f->frames, (unsigned long)f->overruns, (unsigned long)f->work.min,
+           (unsigned long)(f->work.count ? f->work.total / f->work.count : 0),
+           (unsigned long)f->work.max);
+    printf("idle: %u.%u%% busy last second, %u.%u%% peak, %lu waits\n",
+           idle_busy_permille() / 10, idle_busy_permille() % 10,
+           idle_peak_permille() / 10, idle_peak_permille() % 10, (unsigned long)idle_waits());
+    printf("timers: %lu expiries, %lu commands, max %lu due per tick, %lu dropped\n",
+           (unsigned long)tw_get_stats()->expiries, (unsigned long)tw_get_stats()->commands,
+           (unsigned long)tw_get_stats()->max_due, (unsigned long)tw_get_stats()->dropped);
+    if (sw_latency()->count)
+        printf("sw0: %lu moves, input to render %lu/%lu us avg/max\n", (unsigned long)sw_latency()->count,
+               (unsigned long)(sw_latency()->total / sw_latency()->count / (HAL_SYSCLK_HZ / 1000000)),
+               (unsigned long)(sw_latency()->max / (HAL_SYSCLK_HZ / 1000000)));
+    for (int mode = LCD_TIMING_POLLED; mode <= LCD_TIMING_TIMED; mode++) {
+        const struct cycle_stats *l = lcd_latency(mode);
+
+        if (l->count)
+            printf("lcd %s: %lu transfers, ready after %lu/%lu us avg/max, %lu timeouts, %lu resets\n",
+                   mode == LCD_TIMING_TIMED ? "timed" : "polled", (unsigned long)l->count,
+                   (unsigned long)(l->total / l->count / (HAL_SYSCLK_HZ / 1000000)),
+                   (unsigned long)(l->max / (HAL_SYSCLK_HZ / 1000000)),
+                   (unsigned long)lcd_timeouts(), (unsigned long)lcd_resets());
+    }
+    prof_dump(sim_dump_line);
+}
+
+static void session_setup(void)
 {
-    AD1CON1 = 0;
-    AD1CON1bits.SSRC = 7;
-    AD1CON1bits.FORM = 0;
-    AD1CSSL = 0;
-    AD1CON3 = 0x0002;
-    AD1CON2 = 0;
-    AD1CON2bits.VCFG = 0;
-    AD1CON1bits.ON = 1;
+    const char *path;
+    FILE *f;
+    int len;
+
+    atexit(session_report);
+    if ((path = getenv("SIM_REPLAY")) && (f = fopen(path, "rb"))) {
+        len = (int)fread(session, 1, sizeof(session), f);
+        fclose(f);
+        if (!replay_play(session, len))
+            printf("replay: %s is not a session recording\n", path);
+    } else if (getenv("SIM_RECORD")) {
+        replay_record(session, sizeof(session));
+        atexit(session_save);
+    }
 }
+#endif
 
-unsigned int ADC_AnalogRead(unsigned char analogPIN)
+void main(void)
 {
-    int adc_val = 0;
-    AD1CHS = analogPIN << 16;
-    AD1CON1bits.SAMP = 1;
-    while (AD1CON1bits.SAMP);
-    while (!AD1CON1bits.DONE);
-    adc_val = ADC1BUF0;
-    returnadc_val;
+    hal_output(PIN_BUZZER);
+    hal_digital(PIN_BUZZER);
+    hal_output(PIN_LCD_RS); // RS
+    hal_output(PIN_LCD_RW); // RW
+    hal_output(PIN_LCD_EN); // EN
+    hal_output(PORT_LCD_DATA, 0xFF);
+    hal_digital(PORT_LCD_DATA, 0xFF);
+    hal_digital(PIN_LCD_RS);
+
+    hal_input(PIN_ADC_AN2);
+    hal_analog(PIN_ADC_AN2);
+    hal_output(PORT_LEDS, 0x00FF);
+    hal_reg_write(PORT_LEDS, HAL_REG_LAT, 0);
+
+    hal_input(PIN_SW0); // SW0
+
+    init_lcd();
+    adc_init(2);
+    setup_pins();
+    keypad_init();
+    sw_init();
+    rgb_init();
+    sound_init();
+    telemetry_init();
+    init_ssd();
+    init_timer5();
+    
+    // Enable interrupts
+    hal_interrupts_enable();
+
+    load_progress();
+
+#ifdef HAL_SIM
+    session_setup();
+#endif
+
+    fsm_run(states, ST_RIDDLE);
 }
@@ -0,0 +1,37 @@
+#include <string.h>
+#include "playfield.h"
+
+void pf_init(struct playfield *pf)
+{
+    memset(pf, 0, sizeof(*pf));
+}
+
+void pf_place(struct playfield *pf, enum pf_type type, int row, int col)
+{
+    pf->mask[type][row] |= PF_BIT(col);
+}
+
+void pf_spawner(struct playfield *pf, enum pf_type type, unsigned int period, unsigned int first, int row)
+{
+    pf->spawn[type].period = (unsigned char)period;
+    pf->spawn[type].countdown = (unsigned char)first;
+    pf->spawn[type].row = (unsigned char)row;
+}
+
+// Everything moves one column left; column 0 falls off the screen
+void pf_step(struct playfield *pf)
+{
+    int t, row;
+
+    for (t = 0; t < PF_TYPES; t++) {
+        struct pf_spawner *s = &pf->spawn[t];
+
+        for (row = 0; row < PF_ROWS; row++)
+            pf->mask[t][row] >>= 1;
+        if (!s->period || --s->countdown)
+            continue;
+        s->countdown = s->period;
+        pf->mask[t][s->row] |= PF_BIT(PF_COLS - 1);
+        s->row = (unsigned char)((s->row + 1) % PF_ROWS);
+    }
+}
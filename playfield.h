@@ -0,0 +1,49 @@
+#ifndef PLAYFIELD_H
+#define PLAYFIELD_H
+
+// Scrolling playfield on the 16x2 LCD. Entities are not objects: each type
+// keeps one 16-bit occupancy mask per row (bit c = column c), so moving every
+// entity is a shift and a collision test is one AND, however many there are.
+
+#include <stdint.h>
+
+#define PF_ROWS 2
+#define PF_COLS 16
+
+enum pf_type {
+    PF_COIN,
+    PF_BOMB,
+    PF_TYPES
+};
+
+// New entities of one type enter at column 15 every `period` steps,
+// alternating rows
+struct pf_spawner {
+    unsigned char period;      // 0 = never
+    unsigned char countdown;   // steps until the next spawn
+    unsigned char row;         // row of the next spawn
+};
+
+struct playfield {
+    uint16_t mask[PF_TYPES][PF_ROWS];
+    struct pf_spawner spawn[PF_TYPES];
+};
+
+#define PF_BIT(col) ((uint16_t)(1u << (col)))
+
+void pf_init(struct playfield *pf);
+void pf_place(struct playfield *pf, enum pf_type type, int row, int col);
+void pf_spawner(struct playfield *pf, enum pf_type type, unsigned int period, unsigned int first, int row);
+void pf_step(struct playfield *pf);
+
+// Entities of `type` under `player` (a PF_BIT mask) in `row`; removes them when take is set
+static inline uint16_t pf_hit(struct playfield *pf, enum pf_type type, int row, uint16_t player, int take)
+{
+    uint16_t hit = pf->mask[type][row] & player;
+
+    if (take)
+        pf->mask[type][row] &= (uint16_t)~hit;
+    return hit;
+}
+
+#endif
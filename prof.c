@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include "hal.h"
+#include "prof.h"
+
+static const char *const prof_names[PROF_REGIONS] = {
+    [PROF_T5_ISR]      = "t5_isr",
+    [PROF_CN_ISR]      = "cn_isr",
+    [PROF_ADC_ISR]     = "adc_isr",
+    [PROF_LCD_SERVICE] = "lcd_service",
+    [PROF_LCD_BUSY]    = "lcd_busy",
+    [PROF_KEYPAD]      = "keypad",
+    [PROF_SOUND]       = "sound",
+    [PROF_TELEMETRY]   = "telemetry",
+    [PROF_TIMERS]      = "timers",
+    [PROF_FRAME]       = "frame",
+    [PROF_RENDER]      = "render",
+};
+
+// prof_head counts every event since the last resume; the slot is
+// prof_head % PROF_TRACE_SIZE. Written by every interrupt level, so a slot is
+// claimed and filled with interrupts masked.
+static struct prof_event prof_trace[PROF_TRACE_SIZE];
+static volatile uint32_t prof_head;
+static volatile int prof_frozen;
+
+// Each region is updated from a single interrupt level, no masking needed
+static struct cycle_stats prof_region_stats[PROF_REGIONS];
+
+static void prof_record(enum prof_region r, unsigned char kind, uint32_t stamp)
+{
+    struct prof_event *e;
+    uint32_t irq;
+
+    irq = hal_irq_save();
+    if (!prof_frozen) {
+        e = &prof_trace[prof_head & (PROF_TRACE_SIZE - 1)];
+        e->stamp = stamp;
+        e->region = (unsigned char)r;
+        e->kind = kind;
+        prof_head++;
+    }
+    hal_irq_restore(irq);
+}
+
+uint32_t prof_begin(enum prof_region r)
+{
+    uint32_t now = tb_ticks();
+
+    prof_record(r, PROF_BEGIN, now);
+    return now;
+}
+
+void prof_end(enum prof_region r, uint32_t start)
+{
+    uint32_t now = tb_ticks();
+    uint32_t cycles = (now - start) * 2;
+    struct cycle_stats *c = &prof_region_stats[r];
+
+    if (c->count == 0 || cycles < c->min)
+        c->min = cycles;
+    if (cycles > c->max)
+        c->max = cycles;
+    c->total += cycles;
+    c->count++;
+    prof_record(r, PROF_END, now);
+}
+
+void prof_freeze(void)
+{
+    prof_frozen = 1;
+}
+
+void prof_resume(void)
+{
+    uint32_t irq = hal_irq_save();
+
+    prof_head = 0;
+    prof_frozen = 0;
+    hal_irq_restore(irq);
+}
+
+int prof_snapshot(struct prof_event *out, int max)
+{
+    uint32_t head = prof_head;
+    uint32_t n = head < PROF_TRACE_SIZE ? head : PROF_TRACE_SIZE;
+    uint32_t i;
+
+    if (n > (uint32_t)max)
+        n = (uint32_t)max;
+    for (i = 0; i < n; i++)
+        out[i] = prof_trace[(head - n + i) & (PROF_TRACE_SIZE - 1)];
+    return (int)n;
+}
+
+uint32_t prof_lost(void)
+{
+    return prof_head > PROF_TRACE_SIZE ? prof_head - PROF_TRACE_SIZE : 0;
+}
+
+const struct cycle_stats *prof_stats(enum prof_region r)
+{
+    return &prof_region_stats[r];
+}
+
+const char *prof_name(enum prof_region r)
+{
+    return prof_names[r];
+}
+
+void prof_reset_stats(void)
+{
+    int r;
+
+    for (r = 0; r < PROF_REGIONS; r++) {
+        uint32_t irq = hal_irq_save();
+
+        prof_region_stats[r] = (struct cycle_stats){ 0 };
+        hal_irq_restore(irq);
+    }
+}
+
+void prof_dump(void (*put)(const char *line))
+{
+    char line[80];
+    uint32_t head, i, n;
+    int r;
+
+    prof_freeze();
+    head = prof_head;
+    n = head < PROF_TRACE_SIZE ? head : PROF_TRACE_SIZE;
+
+    snprintf(line, sizeof(line), "# prof tb_hz=%lu cycles_per_tick=2 events=%lu lost=%lu",
+             (unsigned long)TB_HZ, (unsigned long)n, (unsigned long)prof_lost());
+    put(line);
+    for (r = 0; r < PROF_REGIONS; r++) {
+        const struct cycle_stats *c = &prof_region_stats[r];
+
+        if (c->count == 0)
+            continue;
+        snprintf(line, sizeof(line), "S %s %lu %lu %lu %lu", prof_names[r],
+                 (unsigned long)c->count, (unsigned long)c->min, (unsigned long)c->max,
+                 (unsigned long)(c->total / c->count));
+        put(line);
+    }
+    for (i = 0; i < n; i++) {
+        const struct prof_event *e = &prof_trace[(head - n + i) & (PROF_TRACE_SIZE - 1)];
+
+        snprintf(line, sizeof(line), "%c %lu %s", e->kind == PROF_BEGIN ? 'B' : 'E',
+                 (unsigned long)e->stamp, prof_names[e->region]);
+        put(line);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef PROF_H
+#define PROF_H
+
+// Region profiler on the core timer. PROF_ENTER/PROF_LEAVE around a region
+// record a begin and an end event into a RAM ring and fold the duration into
+// the region's count/min/max/mean. About a dozen instructions per event, so
+// it stays on in Timer5ISR. Build with -DPROF_ENABLE=0 to compile it out.
+// prof_freeze() stops the ring for prof_dump(); tools/prof_report.c turns a
+// dump into a flame-style report.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#ifndef PROF_ENABLE
+#define PROF_ENABLE 1
+#endif
+
+#define PROF_TRACE_SIZE 256   // events, power of two
+
+// Each region is entered from one interrupt level only
+enum prof_region {
+    PROF_T5_ISR,
+    PROF_CN_ISR,
+    PROF_ADC_ISR,
+    PROF_LCD_SERVICE,
+    PROF_LCD_BUSY,
+    PROF_KEYPAD,
+    PROF_SOUND,
+    PROF_TELEMETRY,
+    PROF_TIMERS,
+    PROF_FRAME,
+    PROF_RENDER,
+    PROF_REGIONS
+};
+
+#define PROF_BEGIN 0
+#define PROF_END   1
+
+struct prof_event {
+    uint32_t stamp;           // tb_ticks()
+    unsigned char region;
+    unsigned char kind;       // PROF_BEGIN / PROF_END
+};
+
+#if PROF_ENABLE
+#define PROF_ENTER(r) uint32_t prof_start_##r = prof_begin(r)
+#define PROF_LEAVE(r) prof_end(r, prof_start_##r)
+#else
+#define PROF_ENTER(r) do { } while (0)
+#define PROF_LEAVE(r) do { } while (0)
+#endif
+
+uint32_t prof_begin(enum prof_region r);
+void prof_end(enum prof_region r, uint32_t start);
+
+void prof_freeze(void);                    // stop recording, the ring keeps its contents
+void prof_resume(void);                    // empty the ring and record again
+int prof_snapshot(struct prof_event *out, int max);   // oldest first, returns the count
+uint32_t prof_lost(void);                  // events overwritten since the last resume
+
+const struct cycle_stats *prof_stats(enum prof_region r);   // SYSCLK cycles
+const char *prof_name(enum prof_region r);
+void prof_reset_stats(void);
+
+// Text dump, one line per call: header, per-region stats, then the frozen ring
+void prof_dump(void (*put)(const char *line));
+
+#endif
@@ -0,0 +1,235 @@
+#include "replay.h"
+#include "lcd.h"
+#include "ssd.h"
+#ifdef HAL_SIM
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+#define RP_VERSION  1
+#define RP_HEADER   3
+#define RP_TRAILER  20   // end record: step delta, op, writes, digest, coins
+
+#define RP_OP_KEY 0x00
+#define RP_OP_SW0 0x10
+#define RP_OP_ADC 0x20
+#define RP_OP_END 0x30
+
+static int rp_mode;
+
+// Recording
+static unsigned char *rp_buf;
+static int rp_size;
+static int rp_len;
+static int rp_overflow;
+static uint32_t rp_last;             // step of the previous record
+static int rp_sw0;                   // last recorded levels, -1 before the first step
+static int rp_adc;
+
+// Playback
+static const unsigned char *rp_in;
+static int rp_in_len;
+static int rp_pos;
+static uint32_t rp_next;             // step of the next record
+static unsigned char rp_play_sw0;
+static unsigned char rp_play_adc;
+static int rp_result = -1;
+
+static void rp_put(unsigned char b)
+{
+    rp_buf[rp_len++] = b;
+}
+
+static void rp_put_varint(uint32_t v)
+{
+    while (v >= 0x80) {
+        rp_put((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    rp_put((unsigned char)v);
+}
+
+static int rp_get(uint32_t *v)
+{
+    if (rp_pos >= rp_in_len)
+        return 0;
+    *v = rp_in[rp_pos++];
+    return 1;
+}
+
+static int rp_get_varint(uint32_t *v)
+{
+    uint32_t b;
+    int shift = 0;
+
+    *v = 0;
+    do {
+        if (!rp_get(&b) || shift > 28)
+            return 0;
+        *v |= (b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return 1;
+}
+
+void replay_digest(struct replay_digest *d)
+{
+    d->lcd_writes = lcd_writes();
+    d->lcd_hash = lcd_digest();
+    d->coins = (uint32_t)ssd_shown();
+}
+
+void replay_record(unsigned char *buf, int size)
+{
+    rp_buf = buf;
+    rp_size = size;
+    rp_len = 0;
+    rp_overflow = size < RP_HEADER + RP_TRAILER;
+    rp_last = 0;
+    rp_sw0 = rp_adc = -1;
+    rp_mode = REPLAY_RECORD;
+    if (!rp_overflow) {
+        rp_put('R');
+        rp_put('P');
+        rp_put(RP_VERSION);
+    }
+}
+
+int replay_play(const unsigned char *stream, int len)
+{
+    rp_mode = REPLAY_OFF;
+    if (len < RP_HEADER || stream[0] != 'R' || stream[1] != 'P' || stream[2] != RP_VERSION)
+        return 0;
+    rp_in = stream;
+    rp_in_len = len;
+    rp_pos = RP_HEADER;
+    rp_result = -1;
+    if (!rp_get_varint(&rp_next))
+        return 0;
+    rp_mode = REPLAY_PLAY;
+    return 1;
+}
+
+int replay_mode(void)
+{
+    return rp_mode;
+}
+
+// Appends one record unless the buffer would leave no room for the end record
+static void rp_emit(uint32_t step, unsigned char op, int arg)
+{
+    if (rp_overflow)
+        return;
+    if (rp_len + 5 + 2 > rp_size - RP_TRAILER) {
+        rp_overflow = 1;
+        return;
+    }
+    rp_put_varint(step - rp_last);
+    rp_last = step;
+    rp_put(op);
+    if (arg >= 0)
+        rp_put((unsigned char)arg);
+}
+
+static void rp_finish(uint32_t step)
+{
+    struct replay_digest now, want;
+    uint32_t b0, b1, b2, b3;
+    int ok;
+
+    replay_digest(&now);
+    ok = rp_get_varint(&want.lcd_writes) && rp_get(&b0) && rp_get(&b1) && rp_get(&b2) && rp_get(&b3)
+         && rp_get_varint(&want.coins);
+    want.lcd_hash = b0 | b1 << 8 | b2 << 16 | b3 << 24;
+    rp_result = ok && now.lcd_writes == want.lcd_writes && now.lcd_hash == want.lcd_hash
+                && now.coins == want.coins;
+    rp_mode = REPLAY_OFF;
+#ifdef HAL_SIM
+    printf("replay: %s at step %lu, %lu LCD writes (recorded %lu), digest %08lx (%08lx), coins %lu (%lu)\n",
+           rp_result ? "identical" : "DIVERGED", (unsigned long)step,
+           (unsigned long)now.lcd_writes, (unsigned long)want.lcd_writes,
+           (unsigned long)now.lcd_hash, (unsigned long)want.lcd_hash,
+           (unsigned long)now.coins, (unsigned long)want.coins);
+    exit(rp_result ? 0 : 1);
+#else
+    (void)step;
+#endif
+}
+
+void replay_step(uint32_t step, struct replay_input *in)
+{
+    int i;
+
+    if (rp_mode == REPLAY_RECORD) {
+        for (i = 0; i < in->keys; i++)
+            rp_emit(step, RP_OP_KEY | ((in->key[i] >> 4) - 1) << 2 | ((in->key[i] & 0x0F) - 1), -1);
+        if (in->sw0 != rp_sw0)
+            rp_emit(step, RP_OP_SW0 | in->sw0, -1);
+        if (in->adc != rp_adc)
+            rp_emit(step, RP_OP_ADC, in->adc);
+        rp_sw0 = in->sw0;
+        rp_adc = in->adc;
+        return;
+    }
+    if (rp_mode != REPLAY_PLAY)
+        return;
+
+    // The pins are ignored: everything comes from the stream
+    in->keys = 0;
+    while (rp_mode == REPLAY_PLAY && rp_next == step) {
+        uint32_t op, v, delta;
+
+        if (!rp_get(&op)) {
+            rp_finish(step);
+            break;
+        }
+        if (op < RP_OP_SW0) {
+            if (in->keys < REPLAY_KEYS)
+                in->key[in->keys++] = (unsigned char)(((op >> 2) + 1) << 4 | ((op & 3) + 1));
+        } else if ((op & 0xF0) == RP_OP_SW0) {
+            rp_play_sw0 = op & 1;
+        } else if (op == RP_OP_ADC && rp_get(&v)) {
+            rp_play_adc = (unsigned char)v;
+        } else {
+            rp_finish(step);
+            break;
+        }
+        if (!rp_get_varint(&delta)) {
+            rp_finish(step);
+            break;
+        }
+        rp_next += delta;
+    }
+    in->sw0 = rp_play_sw0;
+    in->adc = rp_play_adc;
+}
+
+void replay_end(uint32_t step)
+{
+    struct replay_digest d;
+
+    if (rp_mode != REPLAY_RECORD)
+        return;
+    rp_mode = REPLAY_OFF;
+    if (rp_overflow)
+        return;
+    replay_digest(&d);
+    rp_put_varint(step - rp_last);
+    rp_put(RP_OP_END);
+    rp_put_varint(d.lcd_writes);
+    rp_put((unsigned char)d.lcd_hash);
+    rp_put((unsigned char)(d.lcd_hash >> 8));
+    rp_put((unsigned char)(d.lcd_hash >> 16));
+    rp_put((unsigned char)(d.lcd_hash >> 24));
+    rp_put_varint(d.coins);
+}
+
+int replay_length(void)
+{
+    return rp_overflow ? 0 : rp_len;
+}
+
+int replay_result(void)
+{
+    return rp_result;
+}
@@ -0,0 +1,50 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Input record / replay. The fsm samples its inputs once per logical step
+// (one Timer5 tick) and passes them through replay_step(): recording appends
+// whatever changed to a delta-encoded stream, replay overwrites the sample
+// from a stream instead of the pins. Since the fsm schedule runs on the same
+// steps, a replay reproduces the session's LCD writes and coin count exactly.
+//
+// Stream: "RP", version, then records of varint(step delta) + op:
+//   0x00..0x0F  key press, (row-1) << 2 | (col-1)
+//   0x10 | lvl  SW0 level
+//   0x20, v     ADC, v = adc_value() >> (ADC_BITS - 8)
+//   0x30        end, followed by varint(LCD writes), LCD digest (LE32), varint(coins)
+
+#include <stdint.h>
+
+#define REPLAY_OFF    0
+#define REPLAY_RECORD 1
+#define REPLAY_PLAY   2
+
+#define REPLAY_KEYS 4   // key presses per step
+
+struct replay_input {
+    unsigned char sw0;
+    unsigned char adc;                   // 8-bit, what the game logic uses
+    unsigned char keys;
+    unsigned char key[REPLAY_KEYS];      // keypad codes, (row << 4) | col
+};
+
+// Session fingerprint: every queued LCD transfer and the coins shown
+struct replay_digest {
+    uint32_t lcd_writes;
+    uint32_t lcd_hash;
+    uint32_t coins;
+};
+
+void replay_record(unsigned char *buf, int size);
+int replay_play(const unsigned char *stream, int len);   // 0 if the stream is not valid
+int replay_mode(void);
+
+void replay_step(uint32_t step, struct replay_input *in);
+void replay_end(uint32_t step);          // recording: append the end record
+int replay_length(void);                 // bytes recorded, 0 after an overflow
+
+// Playback reached the end record: 1 = identical, 0 = diverged, -1 = running
+int replay_result(void);
+void replay_digest(struct replay_digest *d);
+
+#endif
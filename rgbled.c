@@ -0,0 +1,141 @@
+#include "hal.h"
+#include "rgbled.h"
+
+// round(HAL_RGB_MAX * (i / 255) ^ 2.2): equal steps in the tables look even
+static const unsigned short rgb_gamma[256] = {
+        0,     0,     2,     4,     7,    11,    17,    24,
+       32,    42,    53,    65,    79,    94,   111,   129,
+      148,   169,   192,   216,   242,   270,   299,   330,
+      362,   396,   432,   469,   508,   549,   591,   635,
+      681,   729,   779,   830,   883,   938,   995,  1053,
+     1113,  1175,  1239,  1305,  1373,  1443,  1514,  1587,
+     1663,  1740,  1819,  1900,  1983,  2068,  2155,  2243,
+     2334,  2427,  2521,  2618,  2717,  2817,  2920,  3024,
+     3131,  3240,  3350,  3463,  3578,  3694,  3813,  3934,
+     4057,  4182,  4309,  4438,  4570,  4703,  4838,  4976,
+     5115,  5257,  5401,  5547,  5695,  5845,  5998,  6152,
+     6309,  6468,  6629,  6792,  6957,  7124,  7294,  7466,
+     7640,  7816,  7994,  8175,  8358,  8543,  8730,  8919,
+     9111,  9305,  9501,  9699,  9900, 10102, 10307, 10515,
+    10724, 10936, 11150, 11366, 11585, 11806, 12029, 12254,
+    12482, 12712, 12944, 13179, 13416, 13655, 13896, 14140,
+    14386, 14635, 14885, 15138, 15394, 15652, 15912, 16174,
+    16439, 16706, 16975, 17247, 17521, 17798, 18077, 18358,
+    18642, 18928, 19216, 19507, 19800, 20095, 20393, 20694,
+    20996, 21301, 21609, 21919, 22231, 22546, 22863, 23182,
+    23504, 23829, 24156, 24485, 24817, 25151, 25487, 25826,
+    26168, 26512, 26858, 27207, 27558, 27912, 28268, 28627,
+    28988, 29351, 29717, 30086, 30457, 30830, 31206, 31585,
+    31966, 32349, 32735, 33124, 33514, 33908, 34304, 34702,
+    35103, 35507, 35913, 36321, 36732, 37146, 37562, 37981,
+    38402, 38825, 39252, 39680, 40112, 40546, 40982, 41421,
+    41862, 42306, 42753, 43202, 43654, 44108, 44565, 45025,
+    45487, 45951, 46418, 46888, 47360, 47835, 48313, 48793,
+    49275, 49761, 50249, 50739, 51232, 51728, 52226, 52727,
+    53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+    57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097,
+    61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535,
+};
+
+static const struct rgb_key rgb_off[] = { { 0, 0, 0, 0 }, { 0, 0, 0, RGB_END } };
+static const struct rgb_key rgb_coin[] = {
+    { 0, 255, 0, 60 }, { 0, 255, 0, 120 }, { 0, 0, 0, 420 }, { 0, 0, 0, RGB_END }
+};
+static const struct rgb_key rgb_bomb[] = {
+    { 255, 0, 0, 0 }, { 255, 0, 0, 200 }, { 0, 0, 0, 0 }, { 0, 0, 0, 200 },
+    { 255, 0, 0, 0 }, { 255, 0, 0, 200 }, { 0, 0, 0, 0 }, { 0, 0, 0, 200 },
+    { 255, 0, 0, 0 }, { 255, 0, 0, 200 }, { 255, 64, 0, 0 }, { 0, 0, 0, 800 },
+    { 0, 0, 0, RGB_END }
+};
+static const struct rgb_key rgb_buy[] = {
+    { 0, 64, 255, 150 }, { 0, 200, 255, 150 }, { 0, 0, 0, 500 }, { 0, 0, 0, RGB_END }
+};
+
+static const struct rgb_key *const rgb_seqs[RGB_SEQS] = {
+    [RGB_SEQ_OFF]  = rgb_off,
+    [RGB_SEQ_COIN] = rgb_coin,
+    [RGB_SEQ_BOMB] = rgb_bomb,
+    [RGB_SEQ_BUY]  = rgb_buy,
+};
+
+// Written by main() before it posts the timer start; read on the first expiry
+static volatile unsigned char rgb_request;
+
+// Player state, Timer5 level only. Levels are 8.8 fixed point.
+static void rgb_step(struct tw_timer *t);
+static struct tw_timer rgb_timer = TW_TIMER(rgb_step, 0);
+static const struct rgb_key *rgb_key;   // keyframe being faded to
+static int32_t rgb_level[3];
+static int32_t rgb_delta[3];
+static unsigned int rgb_left;           // updates until rgb_key is reached
+
+static void rgb_snap(const struct rgb_key *k)
+{
+    rgb_level[0] = k->r << 8;
+    rgb_level[1] = k->g << 8;
+    rgb_level[2] = k->b << 8;
+}
+
+// Apply jumps up to the next fade and set up its deltas; 0 at the end
+static int rgb_load(void)
+{
+    unsigned int steps;
+
+    while (rgb_key->ms == 0)
+        rgb_snap(rgb_key++);
+    if (rgb_key->ms == RGB_END)
+        return 0;
+    steps = (rgb_key->ms + RGB_UPDATE_MS / 2) / RGB_UPDATE_MS;
+    if (steps == 0)
+        steps = 1;
+    rgb_delta[0] = ((rgb_key->r << 8) - rgb_level[0]) / (int32_t)steps;
+    rgb_delta[1] = ((rgb_key->g << 8) - rgb_level[1]) / (int32_t)steps;
+    rgb_delta[2] = ((rgb_key->b << 8) - rgb_level[2]) / (int32_t)steps;
+    rgb_left = steps;
+    return 1;
+}
+
+static void rgb_output(void)
+{
+    hal_rgb(rgb_gamma[rgb_level[0] >> 8], rgb_gamma[rgb_level[1] >> 8], rgb_gamma[rgb_level[2] >> 8]);
+}
+
+static void rgb_step(struct tw_timer *t)
+{
+    if (t->fired == 1) {
+        rgb_key = rgb_seqs[rgb_request];
+        rgb_left = 0;
+    }
+    if (rgb_left == 0 && !rgb_load()) {
+        rgb_output();
+        tw_disarm(t);
+        return;
+    }
+    if (--rgb_left) {
+        rgb_level[0] += rgb_delta[0];
+        rgb_level[1] += rgb_delta[1];
+        rgb_level[2] += rgb_delta[2];
+    } else {
+        rgb_snap(rgb_key++);   // land exactly on the keyframe
+    }
+    rgb_output();
+}
+
+void rgb_init(void)
+{
+    hal_output(PIN_LED_RED);
+    hal_output(PIN_LED_GREEN);
+    hal_output(PIN_LED_BLUE);
+    hal_clr(PIN_LED_RED);
+    hal_clr(PIN_LED_GREEN);
+    hal_clr(PIN_LED_BLUE);
+    hal_rgb_init();
+}
+
+void rgb_play(enum rgb_seq seq)
+{
+    if (seq >= RGB_SEQS)
+        return;
+    rgb_request = seq;
+    tw_start(&rgb_timer, 0, TW_MS(RGB_UPDATE_MS));
+}
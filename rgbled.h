@@ -0,0 +1,33 @@
+#ifndef RGBLED_H
+#define RGBLED_H
+
+// RGB LED effects engine. The three channels are Output Compare PWM outputs,
+// so the colour holds without any CPU work. Effects are keyframe sequences
+// in flash; a wheel timer steps the running one every RGB_UPDATE_MS, adding
+// precomputed per-channel deltas and looking the result up in a gamma table.
+// Between effects the timer is disarmed and costs nothing.
+
+#include "twheel.h"
+
+#define RGB_UPDATE_MS 10
+
+// Fade from the current colour to r, g, b over ms (0 jumps there at once)
+struct rgb_key {
+    unsigned char r, g, b;   // perceived brightness, 0..255
+    unsigned short ms;       // RGB_END closes the sequence
+};
+
+#define RGB_END 0xFFFF
+
+enum rgb_seq {
+    RGB_SEQ_OFF,
+    RGB_SEQ_COIN,            // green pulse
+    RGB_SEQ_BOMB,            // red triple flash, orange fade-out
+    RGB_SEQ_BUY,             // blue-cyan pulse
+    RGB_SEQS
+};
+
+void rgb_init(void);         // after adc_init(): the PWM runs on Timer3
+void rgb_play(enum rgb_seq seq);   // main(), replaces the running effect
+
+#endif
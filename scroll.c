@@ -0,0 +1,80 @@
+#include "scroll.h"
+#include "lcd.h"
+
+#define LCD_SET_CGRAM 0x40
+#define SCROLL_SLOTS  (2 * PF_TYPES)
+#define SCROLL_BYTES  (SCROLL_SLOTS * 8)
+
+_Static_assert(SCROLL_SLOT_BASE + SCROLL_SLOTS <= GLYPH_SLOTS, "scroll slots do not fit in CGRAM");
+_Static_assert(SCROLL_CGRAM_BUDGET >= SCROLL_BYTES + 1, "budget cannot refresh every slot in one frame");
+
+// Contents of the streamed slots as last queued, 0xFF = unknown
+static unsigned char scroll_cgram[SCROLL_BYTES];
+static uint32_t scroll_lcd_resets;
+
+void scroll_reset(void)
+{
+    int i;
+
+    for (i = 0; i < SCROLL_BYTES; i++)
+        scroll_cgram[i] = 0xFF;
+}
+
+// Queue the bytes that differ, one address set per run, within the budget
+static int scroll_upload(const unsigned char *want)
+{
+    int spent = 0;
+    int i = 0;
+
+    while (i < SCROLL_BYTES && spent < SCROLL_CGRAM_BUDGET) {
+        if (want[i] == scroll_cgram[i]) {
+            i++;
+            continue;
+        }
+        lcd_cmd(LCD_SET_CGRAM | (SCROLL_SLOT_BASE * 8 + i));
+        spent++;
+        while (i < SCROLL_BYTES && want[i] != scroll_cgram[i] && spent < SCROLL_CGRAM_BUDGET) {
+            lcd_data(want[i]);
+            scroll_cgram[i] = want[i];
+            spent++;
+            i++;
+        }
+    }
+    return spent;
+}
+
+// Returns the CGRAM transfers queued for this frame
+int scroll_render(const struct playfield *pf, const enum glyph_id sprite[PF_TYPES], int sub)
+{
+    unsigned char want[SCROLL_BYTES];
+    int t, r, row, col, spent;
+
+    for (t = 0; t < PF_TYPES; t++) {
+        const unsigned char *bits = glyph_bitmap(sprite[t]);
+
+        for (r = 0; r < 8; r++) {
+            want[(2 * t) * 8 + r] = bits[r] >> sub;
+            want[(2 * t + 1) * 8 + r] = (unsigned char)(bits[r] << (SCROLL_SUBSTEPS - sub)) & 0x1F;
+        }
+    }
+    if (scroll_lcd_resets != lcd_resets()) {
+        scroll_lcd_resets = lcd_resets();
+        scroll_reset();
+    }
+    // New glyphs first: the DDRAM update that follows is the shorter glitch
+    spent = scroll_upload(want);
+
+    // Right halves first so a left half wins a shared cell
+    lcd_fb_clear();
+    for (row = 0; row < PF_ROWS; row++) {
+        for (t = 0; t < PF_TYPES; t++)
+            for (col = 0; col < PF_COLS - 1; col++)
+                if (pf->mask[t][row] & PF_BIT(col))
+                    lcd_fb_put_char(row, col + 1, SCROLL_SLOT_BASE + 2 * t + 1);
+        for (t = 0; t < PF_TYPES; t++)
+            for (col = 0; col < PF_COLS; col++)
+                if (pf->mask[t][row] & PF_BIT(col))
+                    lcd_fb_put_char(row, col, SCROLL_SLOT_BASE + 2 * t);
+    }
+    return spent;
+}
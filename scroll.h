@@ -0,0 +1,24 @@
+#ifndef SCROLL_H
+#define SCROLL_H
+
+// Smooth scrolling of the playfield in 1-pixel steps. An entity whose cell
+// is c and whose offset is sub (0..4 pixels to the right) is drawn as two
+// characters: the left part of the sprite in column c, the rest in c + 1.
+// All entities of a type share the offset, so each type needs just two
+// CGRAM slots, rewritten every frame; DDRAM only changes when the playfield
+// steps a whole cell.
+
+#include "glyph.h"
+#include "playfield.h"
+
+#define SCROLL_SUBSTEPS   5                    // pixels per character cell
+#define SCROLL_SLOT_BASE  GLYPH_CACHE_SLOTS    // [type][left, right]
+
+// LCD transfers a frame may spend on CGRAM; the rest waits for the next frame.
+// At one transfer per Timer5 tick this is 10 ms of bus time.
+#define SCROLL_CGRAM_BUDGET 40
+
+void scroll_reset(void);   // CGRAM slots unknown, rewrite them all
+int scroll_render(const struct playfield *pf, const enum glyph_id sprite[PF_TYPES], int sub);
+
+#endif
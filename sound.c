@@ -0,0 +1,55 @@
+#include "hal.h"
+#include "sound.h"
+#include "timebase.h"
+
+// Sequence ring: main() only advances snd_q_head, Timer5ISR only snd_q_tail
+static const struct note *volatile snd_q[SOUND_QUEUE_SIZE];
+static volatile unsigned char snd_q_head;
+static volatile unsigned char snd_q_tail;
+
+// Sequencer state, Timer5ISR only
+static const struct note *snd_note;
+static unsigned int snd_left;       // ticks until the current note ends
+
+void sound_init(void)
+{
+    hal_tone_init();
+}
+
+int sound_play(const struct note *seq)
+{
+    unsigned char next = (snd_q_head + 1) & (SOUND_QUEUE_SIZE - 1);
+
+    if (next == snd_q_tail)
+        return 0;
+    snd_q[snd_q_head] = seq;
+    snd_q_head = next;
+    return 1;
+}
+
+int sound_busy(void)
+{
+    return snd_note != 0 || snd_q_tail != snd_q_head;
+}
+
+void sound_tick(void)
+{
+    if (snd_left && --snd_left)
+        return;
+
+    // Current note done: next note, or the next queued sequence
+    if (snd_note)
+        snd_note++;
+    while (!snd_note || snd_note->ms == 0) {
+        if (snd_q_tail == snd_q_head) {
+            if (snd_note)
+                hal_tone(0, 0);
+            snd_note = 0;
+            return;
+        }
+        snd_note = snd_q[snd_q_tail];
+        snd_q_tail = (snd_q_tail + 1) & (SOUND_QUEUE_SIZE - 1);
+    }
+    hal_tone(snd_note->hz, snd_note->volume);
+    snd_left = T5_TICKS_MS(snd_note->ms);
+}
@@ -0,0 +1,20 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+// Buzzer sound engine: the Output Compare PWM makes the tone, Timer5 steps
+// through queued note sequences. sound_play() only enqueues a pointer.
+
+struct note {
+    unsigned short hz;       // 0 = rest
+    unsigned short ms;       // 0 ends the sequence
+    unsigned char volume;    // PWM duty in percent, 50 is loudest
+};
+
+#define SOUND_QUEUE_SIZE 4   // power of two
+
+void sound_init(void);
+int sound_play(const struct note *seq);   // 0 if the queue is full
+int sound_busy(void);
+void sound_tick(void);                    // Timer5ISR
+
+#endif
@@ -0,0 +1,287 @@
+#include <string.h>
+#ifdef HAL_SIM
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal_sim.h"
+#endif
+#include "hal.h"
+#include "ssd.h"
+
+#define SSD_ANODES_A (HAL_PIN_MASK(PIN_SSD_AN2) | HAL_PIN_MASK(PIN_SSD_AN3))
+#define SSD_ANODES_B (HAL_PIN_MASK(PIN_SSD_AN0) | HAL_PIN_MASK(PIN_SSD_AN1))
+
+struct ssd_masks {
+    uint32_t a_set, a_clr;   // set = line high (segment off), clr = line low
+    uint32_t b_clr;          // anodes only
+    uint32_t d_set, d_clr;
+    uint32_t g_set, g_clr;
+};
+
+struct ssd_pin {
+    hal_port_t port;
+    uint32_t mask;
+};
+
+static const unsigned char ssd_segments[10] = {
+    0x3F, // 0
+    0x06, // 1
+    0x5B, // 2
+    0x4F, // 3
+    0x66, // 4
+    0x6D, // 5
+    0x7D, // 6
+    0x07, // 7
+    0x7F, // 8
+    0x6F, // 9
+};
+
+// CA..CG, bit order of ssd_segments[]
+static const struct ssd_pin ssd_cathodes[7] = {
+    { PIN_SSD_CA }, { PIN_SSD_CB }, { PIN_SSD_CC }, { PIN_SSD_CD },
+    { PIN_SSD_CE }, { PIN_SSD_CF }, { PIN_SSD_CG }
+};
+
+// Multiplex order: thousands (leftmost, AN3) first
+static const struct ssd_pin ssd_anodes[4] = {
+    { PIN_SSD_AN3 }, { PIN_SSD_AN2 }, { PIN_SSD_AN1 }, { PIN_SSD_AN0 }
+};
+
+// Double buffered so the ISR never sees a half-built frame
+static struct ssd_masks ssd_frames[2][4];
+static volatile unsigned char ssd_active;
+static volatile unsigned char ssd_digit;
+static int ssd_value = -1;
+static struct cycle_stats ssd_cycles;
+
+#if SSD_USE_DMA
+// DMA mode: one channel per port, each replaying four LATxINV words. Entry k
+// is the XOR between the pin levels of digit k-1 and digit k, limited to the
+// display pins, so other functions sharing these ports are never touched.
+static const hal_port_t ssd_dma_ports[4] = { HAL_PORT_A, HAL_PORT_B, HAL_PORT_D, HAL_PORT_G };
+static volatile uint32_t ssd_dma_pattern[4][4];   // [port][digit]
+
+static uint32_t ssd_port_mask(hal_port_t port)
+{
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < 7; i++)
+        if (ssd_cathodes[i].port == port)
+            mask |= ssd_cathodes[i].mask;
+    for (i = 0; i < 4; i++)
+        if (ssd_anodes[i].port == port)
+            mask |= ssd_anodes[i].mask;
+    return mask;
+}
+
+// Display-pin levels of one port while a digit is lit
+static uint32_t ssd_port_level(hal_port_t port, int digit, int value)
+{
+    uint32_t level = ssd_port_mask(port);   // everything off = high
+    unsigned char pattern = ssd_segments[value];
+    int i;
+
+    for (i = 0; i < 7; i++)
+        if (ssd_cathodes[i].port == port && (pattern >> i) & 1)
+            level &= ~ssd_cathodes[i].mask;
+    if (ssd_anodes[digit].port == port)
+        level &= ~ssd_anodes[digit].mask;
+    return level;
+}
+#endif
+
+static void ssd_build(struct ssd_masks *m, int digit, int value)
+{
+    unsigned char pattern = ssd_segments[value];
+    int s;
+
+    memset(m, 0, sizeof(*m));
+    for (s = 0; s < 7; s++) {
+        uint32_t mask = ssd_cathodes[s].mask;
+        int on = (pattern >> s) & 1;   // active-LOW cathodes
+
+        switch (ssd_cathodes[s].port) {
+            case HAL_PORT_A: if (on) m->a_clr |= mask; else m->a_set |= mask; break;
+            case HAL_PORT_D: if (on) m->d_clr |= mask; else m->d_set |= mask; break;
+            case HAL_PORT_G: if (on) m->g_clr |= mask; else m->g_set |= mask; break;
+            default: break;
+        }
+    }
+
+    // Active-LOW anode, enabled by the final CLR write of its port
+    if (ssd_anodes[digit].port == HAL_PORT_A)
+        m->a_clr |= ssd_anodes[digit].mask;
+    else
+        m->b_clr |= ssd_anodes[digit].mask;
+}
+
+void init_ssd(void)
+{
+    // Configure anode pins as outputs
+    hal_output(PIN_SSD_AN0);
+    hal_output(PIN_SSD_AN1);
+    hal_output(PIN_SSD_AN2);
+    hal_output(PIN_SSD_AN3);
+    
+    // Configure cathode pins as outputs
+    hal_output(PIN_SSD_CA);
+    hal_output(PIN_SSD_CB);
+    hal_output(PIN_SSD_CC);
+    hal_output(PIN_SSD_CD);
+    hal_output(PIN_SSD_CE);
+    hal_output(PIN_SSD_CF);
+    hal_output(PIN_SSD_CG);
+    
+    // Disable analog functionality for AN0 and AN1
+    hal_digital(PIN_SSD_AN0);
+    hal_digital(PIN_SSD_AN1);
+    
+    // Initialize all digits off (anodes high)
+    hal_set(PIN_SSD_AN0);
+    hal_set(PIN_SSD_AN1);
+    hal_set(PIN_SSD_AN2);
+    hal_set(PIN_SSD_AN3);
+    
+    // Initialize all segments off (cathodes high for common anode)
+    hal_set(PIN_SSD_CA);
+    hal_set(PIN_SSD_CB);
+    hal_set(PIN_SSD_CC);
+    hal_set(PIN_SSD_CD);
+    hal_set(PIN_SSD_CE);
+    hal_set(PIN_SSD_CF);
+    hal_set(PIN_SSD_CG);
+
+#if SSD_USE_DMA
+    // Same 250 us cadence as the Timer5 tick
+    hal_timer3_event_init(T5_TCKPS, T5_PR);
+#endif
+    display_coins(0);
+}
+
+static void ssd_digits(int coin_count, int digits[4])
+{
+    digits[0] = (coin_count / 1000) % 10;
+    digits[1] = (coin_count / 100) % 10;
+    digits[2] = (coin_count / 10) % 10;
+    digits[3] = coin_count % 10;
+}
+
+#if SSD_USE_DMA
+static void ssd_dma_load(const int digits[4])
+{
+    int p, d;
+
+    for (p = 0; p < 4; p++)
+        hal_dma_stop(p);
+
+    for (p = 0; p < 4; p++) {
+        hal_port_t port = ssd_dma_ports[p];
+        uint32_t last = ssd_port_level(port, 3, digits[3]);
+
+        // Park the pins on digit 3 so the first delta lands on digit 0
+        hal_set(port, last);
+        hal_clr(port, ssd_port_mask(port) & ~last);
+        for (d = 0; d < 4; d++) {
+            uint32_t level = ssd_port_level(port, d, digits[d]);
+            ssd_dma_pattern[p][d] = level ^ last;
+            last = level;
+        }
+    }
+
+    for (p = 0; p < 4; p++)
+        hal_dma_cyclic(p, ssd_dma_pattern[p], 4, ssd_dma_ports[p], HAL_REG_LAT + HAL_REG_INV);
+}
+#endif
+
+#if SSD_USE_DMA && defined(HAL_SIM)
+// Simulator check, with the channels held from before ssd_dma_load(): step
+// the simulated DMA engine through two full cycles from the parked pins, then
+// run ssd_refresh() as many times, and require the same display-pin levels on
+// LATA/B/D/G after every digit. Both end on digit 3, which is the park state.
+static void ssd_check_dma(void)
+{
+    uint32_t pins[8][4];
+    struct cycle_stats cycles = ssd_cycles;
+    int p, step;
+
+    for (step = 0; step < 8; step++) {
+        sim_dma_step();
+        for (p = 0; p < 4; p++)
+            pins[step][p] = sim_latch(ssd_dma_ports[p]) & ssd_port_mask(ssd_dma_ports[p]);
+    }
+
+    ssd_digit = 0;
+    for (step = 0; step < 8; step++) {
+        ssd_refresh();
+        for (p = 0; p < 4; p++) {
+            uint32_t isr = sim_latch(ssd_dma_ports[p]) & ssd_port_mask(ssd_dma_ports[p]);
+
+            if (pins[step][p] != isr) {
+                fprintf(stderr, "ssd: DMA waveform differs from ISR at step %d port %d (%08x vs %08x)\n",
+                        step, (int)ssd_dma_ports[p], (unsigned)pins[step][p], (unsigned)isr);
+                abort();
+            }
+        }
+    }
+    ssd_cycles = cycles;
+}
+#endif
+
+int ssd_shown(void)
+{
+    return ssd_value;
+}
+
+void display_coins(int coin_count)
+{
+    struct ssd_masks *frame;
+    int digits[4];
+    int next, d;
+
+    if (coin_count == ssd_value)
+        return;
+    ssd_value = coin_count;
+    ssd_digits(coin_count, digits);
+
+    next = !ssd_active;
+    frame = ssd_frames[next];
+    for (d = 0; d < 4; d++)
+        ssd_build(&frame[d], d, digits[d]);
+    ssd_active = next;
+
+#if SSD_USE_DMA
+#ifdef HAL_SIM
+    sim_dma_hold(1);
+    ssd_dma_load(digits);
+    ssd_check_dma();
+    sim_dma_hold(0);
+#else
+    ssd_dma_load(digits);
+#endif
+#endif
+}
+
+// Timer5ISR: one digit per tick, atomic SET/CLR writes only
+void ssd_refresh(void)
+{
+    uint32_t start = tb_ticks();
+    const struct ssd_masks *m = &ssd_frames[ssd_active][ssd_digit];
+
+    // Blank every digit, then drive this digit's segments and anode
+    hal_set(HAL_PORT_B, SSD_ANODES_B);
+    hal_set(HAL_PORT_A, SSD_ANODES_A | m->a_set);
+    hal_set(HAL_PORT_D, m->d_set);
+    hal_clr(HAL_PORT_D, m->d_clr);
+    hal_set(HAL_PORT_G, m->g_set);
+    hal_clr(HAL_PORT_G, m->g_clr);
+    hal_clr(HAL_PORT_A, m->a_clr);
+    hal_clr(HAL_PORT_B, m->b_clr);
+
+    ssd_digit = (ssd_digit + 1) & 3;
+    cycle_stats_add(&ssd_cycles, start);
+}
+
+const struct cycle_stats *ssd_refresh_cycles(void)
+{
+    return &ssd_cycles;
+}
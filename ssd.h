@@ -0,0 +1,22 @@
+#ifndef SSD_H
+#define SSD_H
+
+// Four-digit common-anode seven-segment display. display_coins() decodes the
+// value once; either ssd_refresh() replays per-digit LATxSET/LATxCLR masks from
+// Timer5ISR, or four DMA channels replay LATxINV deltas on Timer3 events.
+
+#include "timebase.h"
+
+// 1: DMA replays the pattern on Timer3 events, no CPU work per digit.
+// 0: Timer5ISR calls ssd_refresh() (fallback).
+#ifndef SSD_USE_DMA
+#define SSD_USE_DMA 1
+#endif
+
+void init_ssd(void);
+void display_coins(int coin_count);
+int ssd_shown(void);          // last value passed to display_coins(), -1 before
+void ssd_refresh(void);
+const struct cycle_stats *ssd_refresh_cycles(void);
+
+#endif
@@ -0,0 +1,153 @@
+#include "hal.h"
+#include "switches.h"
+
+#define SW_LOCK_TICKS T5_TICKS_MS(SW_DEBOUNCE_MS)
+
+_Static_assert(SW_LOCK_TICKS > 0 && SW_LOCK_TICKS < 256, "lockout does not fit its counter");
+
+struct sw_pin {
+    hal_port_t port;
+    uint32_t mask;
+};
+
+static const struct sw_pin sw_pins[SW_COUNT] = {
+    { PIN_SW0 }, { PIN_SW1 }, { PIN_SW2 }, { PIN_SW3 }
+};
+
+#define SW_PORT_F_PINS (HAL_PIN_MASK(PIN_SW0) | HAL_PIN_MASK(PIN_SW1) | HAL_PIN_MASK(PIN_SW2))
+#define SW_PORT_D_PINS HAL_PIN_MASK(PIN_SW3)
+
+// Edge ring: the CN ISR and Timer5 (same priority, never nested) only advance
+// sw_q_head, main() only sw_q_tail
+static volatile struct sw_edge sw_q[SW_QUEUE_SIZE];
+static volatile unsigned char sw_q_head;
+static volatile unsigned char sw_q_tail;
+static volatile uint32_t sw_lost_count;
+
+// Debouncer state, touched only at interrupt priority 4
+static volatile uint32_t sw_snap;
+static unsigned int sw_state;            // debounced levels
+static unsigned int sw_locked;           // bit n: SWn is inside its lockout
+static unsigned char sw_lock[SW_COUNT];  // ticks left
+static uint32_t sw_edges;
+
+static struct cycle_stats sw_lat;        // main() only
+
+// One PORTF and one PORTD read; re-arms their change notification latches
+static unsigned int sw_read(void)
+{
+    uint32_t f = hal_reg_read(HAL_PORT_F, HAL_REG_PORT);
+    uint32_t d = hal_reg_read(HAL_PORT_D, HAL_REG_PORT);
+    unsigned int levels = 0;
+    int i;
+
+    for (i = 0; i < SW_COUNT; i++)
+        if ((sw_pins[i].port == HAL_PORT_F ? f : d) & sw_pins[i].mask)
+            levels |= 1u << i;
+    return levels;
+}
+
+static void sw_accept(unsigned int changed, unsigned int levels, uint32_t stamp)
+{
+    unsigned char next;
+    int i;
+
+    for (i = 0; i < SW_COUNT; i++) {
+        if (!(changed & (1u << i)))
+            continue;
+        sw_state ^= 1u << i;
+        sw_locked |= 1u << i;
+        sw_lock[i] = SW_LOCK_TICKS;
+        sw_edges++;
+
+        next = (sw_q_head + 1) & (SW_QUEUE_SIZE - 1);
+        if (next == sw_q_tail) {
+            sw_lost_count++;
+            continue;
+        }
+        sw_q[sw_q_head].stamp = stamp;
+        sw_q[sw_q_head].index = (unsigned char)i;
+        sw_q[sw_q_head].level = (levels >> i) & 1;
+        sw_q_head = next;
+    }
+    sw_snap = (sw_edges << SW_SNAP_SHIFT) | sw_state;
+}
+
+void sw_init(void)
+{
+    int i;
+
+    for (i = 0; i < SW_COUNT; i++)
+        hal_input(sw_pins[i].port, sw_pins[i].mask);
+    hal_cn_enable(HAL_PORT_F, SW_PORT_F_PINS);
+    hal_cn_enable(HAL_PORT_D, SW_PORT_D_PINS);
+    hal_cn_ack(HAL_PORT_F);
+    hal_cn_ack(HAL_PORT_D);
+    sw_state = sw_read();
+    sw_snap = sw_state;
+    hal_cn_irq(HAL_PORT_F, 1);
+    hal_cn_irq(HAL_PORT_D, 1);
+}
+
+// Bounces inside a lockout only cost the acknowledge
+void sw_change(void)
+{
+    uint32_t stamp = tb_ticks();
+    unsigned int levels;
+
+    hal_cn_ack(HAL_PORT_F);
+    hal_cn_ack(HAL_PORT_D);
+    levels = sw_read();
+    sw_accept((levels ^ sw_state) & ~sw_locked, levels, stamp);
+}
+
+void sw_tick(void)
+{
+    unsigned int expired = 0;
+    unsigned int levels;
+    int i;
+
+    if (!sw_locked)
+        return;
+    for (i = 0; i < SW_COUNT; i++)
+        if ((sw_locked & (1u << i)) && --sw_lock[i] == 0)
+            expired |= 1u << i;
+    if (!expired)
+        return;
+
+    // A switch that settled against its last edge flips back now
+    sw_locked &= ~expired;
+    levels = sw_read();
+    sw_accept((levels ^ sw_state) & expired, levels, tb_ticks());
+}
+
+uint32_t sw_snapshot(void)
+{
+    return sw_snap;
+}
+
+int sw_get_edge(struct sw_edge *e)
+{
+    if (sw_q_tail == sw_q_head)
+        return 0;
+    e->stamp = sw_q[sw_q_tail].stamp;
+    e->index = sw_q[sw_q_tail].index;
+    e->level = sw_q[sw_q_tail].level;
+    sw_q_tail = (sw_q_tail + 1) & (SW_QUEUE_SIZE - 1);
+    return 1;
+}
+
+uint32_t sw_lost(void)
+{
+    return sw_lost_count;
+}
+
+void sw_rendered(uint32_t stamp)
+{
+    cycle_stats_add(&sw_lat, stamp);
+}
+
+const struct cycle_stats *sw_latency(void)
+{
+    return &sw_lat;
+}
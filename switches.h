@@ -0,0 +1,40 @@
+#ifndef SWITCHES_H
+#define SWITCHES_H
+
+// Slide switches SW0..SW3 (RF3, RF5, RF4, RD15) on change notification.
+// An edge is taken at once in the CN interrupt and the switch is then locked
+// for SW_DEBOUNCE_MS, so contact bounce adds no delay. The Timer5 tick ends
+// the lockout and, if the switch settled the other way, reports that as a
+// second edge. Accepted edges are queued with their core timer stamp, and
+// the debounced levels are published as a single word.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#define SW_COUNT       4
+#define SW_DEBOUNCE_MS 20
+#define SW_QUEUE_SIZE  16   // power of two
+
+struct sw_edge {
+    uint32_t stamp;         // tb_ticks() in the interrupt that saw the change
+    unsigned char index;    // 0..3 = SW0..SW3
+    unsigned char level;
+};
+
+// Snapshot word: bit n = SWn level, the edge count from bit SW_SNAP_SHIFT up
+#define SW_SNAP_SHIFT   8
+#define SW_LEVELS(snap) ((snap) & ((1u << SW_COUNT) - 1))
+
+void sw_init(void);         // after keypad_init(), which sets the CN priority
+void sw_change(void);       // change-notification ISR
+void sw_tick(void);         // Timer5ISR
+
+uint32_t sw_snapshot(void);
+int sw_get_edge(struct sw_edge *e);   // main(), 0 if none is queued
+uint32_t sw_lost(void);               // edges dropped with the queue full
+
+// Input-to-render latency: main() passes an edge's stamp once the change is drawn
+void sw_rendered(uint32_t stamp);
+const struct cycle_stats *sw_latency(void);   // SYSCLK cycles
+
+#endif
@@ -0,0 +1,177 @@
+#include <string.h>
+#include "hal.h"
+#include "telemetry.h"
+#include "idle.h"
+#include "ssd.h"
+
+// The seven-segment display takes all four DMA channels in its DMA mode;
+// then the service tops up the 8-byte UART FIFO instead, which at one tick
+// per 250 us still outruns the line.
+#ifndef TLM_USE_DMA
+#define TLM_USE_DMA (!SSD_USE_DMA)
+#endif
+#define TLM_DMA_CHANNEL 3
+
+#define TLM_LEVELS    8      // one ring per interrupt priority, 0 = main()
+#define TLM_RING_SIZE 64     // power of two
+#define TLM_TX_SIZE   64
+
+_Static_assert(TLM_OVERHEAD + TLM_MAX_PAYLOAD < TLM_RING_SIZE, "frame does not fit a ring");
+_Static_assert(TLM_OVERHEAD + TLM_MAX_PAYLOAD <= TLM_TX_SIZE, "frame does not fit the TX buffer");
+
+// Producer: code running at that priority only advances head. Consumer:
+// telemetry_service() only advances tail. Holds whole frames.
+struct tlm_ring {
+    unsigned char buf[TLM_RING_SIZE];
+    volatile unsigned char head;
+    volatile unsigned char tail;
+    volatile uint16_t dropped;
+};
+
+static struct tlm_ring tlm_rings[TLM_LEVELS];
+
+// Owned by telemetry_service(); DMA reads tlm_tx until it goes idle
+static unsigned char tlm_tx[TLM_TX_SIZE];
+static int tlm_tx_len;
+static int tlm_tx_pos;
+
+static const uint16_t tlm_crc_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t tlm_crc(uint16_t crc, unsigned char b)
+{
+    crc = (uint16_t)(crc << 4) ^ tlm_crc_nibble[(crc >> 12) ^ (b >> 4)];
+    crc = (uint16_t)(crc << 4) ^ tlm_crc_nibble[(crc >> 12) ^ (b & 0x0F)];
+    return crc;
+}
+
+static void put16(unsigned char *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+}
+
+void telemetry_init(void)
+{
+    memset(tlm_rings, 0, sizeof(tlm_rings));
+    tlm_tx_len = tlm_tx_pos = 0;
+    hal_uart_init(TLM_BAUD);
+}
+
+int telemetry_send(unsigned char type, const void *payload, unsigned char len)
+{
+    struct tlm_ring *r = &tlm_rings[hal_irq_level() & (TLM_LEVELS - 1)];
+    unsigned char frame[TLM_OVERHEAD + TLM_MAX_PAYLOAD];
+    unsigned char head = r->head;
+    unsigned char used = (head - r->tail) & (TLM_RING_SIZE - 1);
+    uint16_t crc = 0xFFFF;
+    int n = TLM_OVERHEAD + len, i;
+
+    if (len > TLM_MAX_PAYLOAD || n > TLM_RING_SIZE - 1 - used) {
+        r->dropped++;
+        return 0;
+    }
+
+    frame[0] = TLM_SYNC;
+    frame[1] = type;
+    frame[2] = len;
+    put32(frame + 3, micros());
+    memcpy(frame + 7, payload, len);
+    for (i = 1; i < 7 + len; i++)
+        crc = tlm_crc(crc, frame[i]);
+    put16(frame + 7 + len, crc);
+
+    for (i = 0; i < n; i++)
+        r->buf[(head + i) & (TLM_RING_SIZE - 1)] = frame[i];
+    r->head = (head + n) & (TLM_RING_SIZE - 1);   // publish the whole frame
+    return 1;
+}
+
+// Move whole frames from the rings into tlm_tx while they fit
+static void tlm_fill(void)
+{
+    int level;
+
+    tlm_tx_len = tlm_tx_pos = 0;
+    for (level = 0; level < TLM_LEVELS; level++) {
+        struct tlm_ring *r = &tlm_rings[level];
+        unsigned char tail = r->tail;
+
+        while (tail != r->head) {
+            int n = TLM_OVERHEAD + r->buf[(tail + 2) & (TLM_RING_SIZE - 1)], i;
+
+            if (tlm_tx_len + n > TLM_TX_SIZE)
+                break;
+            for (i = 0; i < n; i++)
+                tlm_tx[tlm_tx_len++] = r->buf[(tail + i) & (TLM_RING_SIZE - 1)];
+            tail = (tail + n) & (TLM_RING_SIZE - 1);
+        }
+        r->tail = tail;
+    }
+}
+
+void telemetry_service(void)
+{
+#if TLM_USE_DMA
+    if (hal_dma_busy(TLM_DMA_CHANNEL))
+        return;
+    tlm_fill();
+    if (tlm_tx_len)
+        hal_dma_uart(TLM_DMA_CHANNEL, tlm_tx, tlm_tx_len);
+#else
+    if (tlm_tx_pos == tlm_tx_len)
+        tlm_fill();
+    while (tlm_tx_pos < tlm_tx_len && hal_uart_put(tlm_tx[tlm_tx_pos]))
+        tlm_tx_pos++;
+#endif
+}
+
+void telemetry_frame(const struct frame_clock *f)
+{
+    unsigned char p[16];
+    uint32_t dropped = telemetry_dropped();
+
+    put32(p, f->frames);
+    put32(p + 4, f->overruns);
+    put32(p + 8, f->work.max);
+    put16(p + 12, idle_busy_permille());
+    put16(p + 14, dropped > 0xFFFF ? 0xFFFF : dropped);
+    telemetry_send(TLM_FRAME, p, sizeof(p));
+}
+
+void telemetry_score(unsigned char event, unsigned int coins, int row)
+{
+    unsigned char p[4];
+
+    p[0] = event;
+    put16(p + 1, coins);
+    p[3] = (unsigned char)row;
+    telemetry_send(TLM_SCORE, p, sizeof(p));
+}
+
+void telemetry_adc(unsigned int raw, unsigned int value)
+{
+    unsigned char p[4];
+
+    put16(p, raw);
+    put16(p + 2, value);
+    telemetry_send(TLM_ADC, p, sizeof(p));
+}
+
+uint32_t telemetry_dropped(void)
+{
+    uint32_t total = 0;
+    int level;
+
+    for (level = 0; level < TLM_LEVELS; level++)
+        total += tlm_rings[level].dropped;
+    return total;
+}
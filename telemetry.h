@@ -0,0 +1,37 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Binary telemetry on UART4 (USB-UART bridge, 115200 8N1). Any context may
+// send: each interrupt level owns a single-producer ring, so senders never
+// lock or wait and a full ring just drops the frame. telemetry_service() in
+// Timer5ISR moves whole frames into the transmit buffer and hands it to DMA.
+//
+// Frame: TLM_SYNC, type, len, timestamp (us, LE32), payload[len], CRC (LE16)
+// CRC-16/CCITT-FALSE over type..payload. tools/tlm_decode.c reads captures.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#define TLM_BAUD        115200
+#define TLM_SYNC        0xA5
+#define TLM_MAX_PAYLOAD 16
+#define TLM_OVERHEAD    9        // sync, type, len, timestamp, CRC
+
+// Record types, payloads little-endian
+#define TLM_FRAME 1   // frames u32, overruns u32, work max cycles u32, busy permille u16, dropped u16
+#define TLM_SCORE 2   // event u8, coins u16, player row u8
+#define TLM_ADC   3   // raw u16 (10-bit), filtered u16 (12-bit)
+
+#define TLM_SCORE_COIN 1
+#define TLM_SCORE_BOMB 2
+
+void telemetry_init(void);
+void telemetry_service(void);    // Timer5ISR
+
+int telemetry_send(unsigned char type, const void *payload, unsigned char len);   // 0 if dropped
+void telemetry_frame(const struct frame_clock *f);
+void telemetry_score(unsigned char event, unsigned int coins, int row);
+void telemetry_adc(unsigned int raw, unsigned int value);
+uint32_t telemetry_dropped(void);
+
+#endif
@@ -0,0 +1,105 @@
+#include "timebase.h"
+
+// Compile-time checks of the clock tree and the derived Timer5 constants
+_Static_assert(HAL_SYSCLK_HZ == 80000000UL, "FPLL config bits no longer give 80 MHz");
+_Static_assert(HAL_FRC_HZ / HAL_PLL_IDIV >= 4000000UL && HAL_FRC_HZ / HAL_PLL_IDIV <= 5000000UL,
+               "PLL input must be 4..5 MHz");
+_Static_assert(HAL_PBCLK_HZ % (T5_PRESCALE * 1000000UL) == 0, "Timer5 tick is not a whole number of counts");
+_Static_assert(T5_PR > 0 && T5_PR <= 0xFFFF, "PR5 out of range for a 16-bit timer");
+_Static_assert((uint64_t)(T5_PR + 1) * T5_PRESCALE * 1000000 / HAL_PBCLK_HZ == T5_TICK_US,
+               "PR5/prescaler do not produce T5_TICK_US");
+_Static_assert(TB_TICKS_PER_US * 1000000UL == TB_HZ, "core timer rate is not a whole number of MHz");
+
+// Written only by tb_tick() in Timer5ISR
+static volatile uint32_t tb_hi;
+static volatile uint32_t tb_last;
+static volatile uint32_t tb_count;
+
+uint32_t tb_ticks(void)
+{
+    return hal_core_timer();
+}
+
+uint64_t tb_ticks64(void)
+{
+    uint32_t hi, last, lo;
+
+    do {
+        hi = tb_hi;
+        last = tb_last;
+        lo = hal_core_timer();
+    } while (hi != tb_hi);
+
+    // Wrapped since the last Timer5 tick
+    if (lo < last)
+        hi++;
+    return ((uint64_t)hi << 32) | lo;
+}
+
+uint32_t millis(void)
+{
+    return (uint32_t)(tb_ticks64() / TB_TICKS_PER_MS);
+}
+
+uint32_t micros(void)
+{
+    return (uint32_t)(tb_ticks64() / TB_TICKS_PER_US);
+}
+
+void tb_tick(void)
+{
+    uint32_t now = hal_core_timer();
+
+    if (now < tb_last)
+        tb_hi++;
+    tb_last = now;
+    tb_count++;
+}
+
+uint32_t tb_tick_count(void)
+{
+    return tb_count;
+}
+
+void tb_sleep_until(uint32_t deadline)
+{
+    while (!tb_expired(deadline))
+        ;
+}
+
+void frame_start(struct frame_clock *f, uint32_t rate_mhz, uint32_t now)
+{
+    f->period = (uint32_t)((uint64_t)TB_HZ * 1000 / rate_mhz);
+    f->frames = 0;
+    f->overruns = 0;
+    f->work = (struct cycle_stats){ 0 };
+    f->start = tb_ticks();
+    f->deadline = now;
+}
+
+int frame_due(struct frame_clock *f, uint32_t now)
+{
+    if ((int32_t)(now - f->deadline) < 0)
+        return 0;
+    f->start = tb_ticks();
+    f->deadline += f->period;
+    return 1;
+}
+
+void frame_end(struct frame_clock *f)
+{
+    cycle_stats_add(&f->work, f->start);
+    f->frames++;
+    if (tb_ticks() - f->start > f->period)
+        f->overruns++;
+}
+
+void delay_ms(int ms)
+{
+    tb_sleep_until(tb_deadline_ms(ms));
+}
+
+void delay_us(unsigned int us)
+{
+    tb_sleep_until(tb_deadline_us(us));
+}
@@ -0,0 +1,81 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+// Monotonic timebase on the MIPS core timer (CP0 Count, SYSCLK / 2).
+// Replaces the calibrated busy loops, so delays no longer depend on the
+// optimisation level or prefetch cache settings.
+
+#include <stdint.h>
+#include "hal.h"
+
+#define TB_HZ           (HAL_SYSCLK_HZ / 2)
+#define TB_TICKS_PER_MS (TB_HZ / 1000)
+#define TB_TICKS_PER_US (TB_HZ / 1000000)
+
+// Timer5 tick derived from the clock tree: 250 us at PBCLK / 16
+#define T5_TICK_US      250
+#define T5_TCKPS        4
+#define T5_PRESCALE     (1u << T5_TCKPS)    // valid for TCKPS 0..6
+#define T5_PR           ((HAL_PBCLK_HZ / T5_PRESCALE) / 1000000 * T5_TICK_US - 1)
+#define T5_TICKS_MS(ms) ((ms) * 1000 / T5_TICK_US)
+
+uint32_t tb_ticks(void);                 // raw core timer, wraps every ~107 s
+uint64_t tb_ticks64(void);               // extended by tb_tick(), never wraps
+uint32_t millis(void);
+uint32_t micros(void);
+
+// Deadlines are raw tb_ticks() values, compared modulo 2^32
+static inline uint32_t tb_deadline_ms(uint32_t ms) { return tb_ticks() + ms * TB_TICKS_PER_MS; }
+static inline uint32_t tb_deadline_us(uint32_t us) { return tb_ticks() + us * TB_TICKS_PER_US; }
+static inline int tb_expired(uint32_t deadline)    { return (int32_t)(tb_ticks() - deadline) >= 0; }
+static inline int tb_elapsed(uint32_t since, uint32_t ticks) { return tb_ticks() - since >= ticks; }
+
+void tb_sleep_until(uint32_t deadline);
+
+// Cycle accounting for short regions (ISRs): SYSCLK cycles from a tb_ticks() start
+struct cycle_stats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+static inline void cycle_stats_put(struct cycle_stats *c, uint32_t cycles)
+{
+    if (c->count == 0 || cycles < c->min)
+        c->min = cycles;
+    if (cycles > c->max)
+        c->max = cycles;
+    c->total += cycles;
+    c->count++;
+}
+
+static inline void cycle_stats_add(struct cycle_stats *c, uint32_t start)
+{
+    cycle_stats_put(c, (tb_ticks() - start) * 2);
+}
+void tb_tick(void);                      // from Timer5ISR, keeps tb_ticks64() monotonic
+uint32_t tb_tick_count(void);            // Timer5 ticks since reset
+
+// Fixed timestep without blocking. The schedule runs on a caller-supplied
+// clock in core timer units (the fsm passes its logical step time), so the
+// sequence of frames is reproducible; only the work statistics use the real
+// core timer. frame_due() opens a frame once its deadline has passed,
+// frame_end() closes it. The first frame is due at once.
+struct frame_clock {
+    uint32_t period;                     // core timer ticks
+    uint32_t start;                      // real tb_ticks() when this frame's work began
+    uint32_t deadline;                   // next frame begins
+    uint32_t frames;
+    uint32_t overruns;                   // work took longer than the period
+    struct cycle_stats work;             // SYSCLK cycles of work per frame
+};
+
+void frame_start(struct frame_clock *f, uint32_t rate_mhz, uint32_t now);   // rate in mHz
+int frame_due(struct frame_clock *f, uint32_t now);
+void frame_end(struct frame_clock *f);
+
+void delay_ms(int ms);
+void delay_us(unsigned int us);
+
+#endif
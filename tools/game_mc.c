@@ -0,0 +1,280 @@
+// Host tool: headless Monte Carlo runs of the game rules (game.c) for
+// difficulty tuning. Plays many sessions per difficulty with an SW0 policy on
+// all cores and prints survival time and coin rate distributions.
+//
+//   cc -O2 -pthread -I. -o game_mc tools/game_mc.c game.c playfield.c
+//   ./game_mc [-n sessions] [-j threads] [-m max_seconds] [-s seed] [policy ...]
+//
+// Policies (default: all of them):
+//   stay          never touch SW0
+//   toggle:N      flip SW0 every N frames
+//   random:P      flip SW0 with probability P each frame
+//   dodge:E       move away from a bomb about to reach the player, towards a
+//                 coin otherwise; picks the wrong row with probability E per frame
+//
+// Every session seeds its own generator from -s and its index, so results do
+// not depend on the thread count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "game.h"
+
+enum policy_kind { POL_STAY, POL_TOGGLE, POL_RANDOM, POL_DODGE };
+
+struct policy {
+    enum policy_kind kind;
+    double arg;
+    char name[32];
+};
+
+struct session {
+    uint32_t frames;          // survived, capped at the time limit
+    unsigned int coins;
+    int capped;               // still alive at the limit
+};
+
+struct job {
+    const struct policy *pol;
+    int speed;
+    int sessions;
+    uint32_t max_frames;
+    uint64_t seed;
+    struct session *out;
+    int next;                 // shared session counter
+    pthread_mutex_t lock;
+};
+
+static uint64_t rng_next(uint64_t *s)
+{
+    // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_unit(uint64_t *s)
+{
+    return (double)(rng_next(s) >> 11) / 9007199254740992.0;
+}
+
+// SW0 level for the coming frame
+static int policy_sw0(const struct policy *p, const struct game *g, int sw0, uint64_t *rng)
+{
+    int row, other, want;
+
+    switch (p->kind) {
+        case POL_STAY:
+            return sw0;
+        case POL_TOGGLE:
+            return g->frames && g->frames % (uint32_t)p->arg == 0 ? !sw0 : sw0;
+        case POL_RANDOM:
+            return rng_unit(rng) < p->arg ? !sw0 : sw0;
+        case POL_DODGE:
+            // Collisions are tested when the entities land on column 0
+            row = g->player_row;
+            other = !row;
+            want = row;
+            if (g->pf.mask[PF_BOMB][row] & PF_BIT(g->player_col))
+                want = other;
+            else if ((g->pf.mask[PF_COIN][other] & PF_BIT(g->player_col))
+                     && !(g->pf.mask[PF_BOMB][other] & PF_BIT(g->player_col)))
+                want = other;
+            if (rng_unit(rng) < p->arg)
+                want = !want;
+            return want == 0;
+    }
+    return sw0;
+}
+
+static void play_session(const struct job *j, int index, struct session *s)
+{
+    uint64_t rng = j->seed ^ (0x9E3779B97F4A7C15ULL * (uint64_t)(index + 1));
+    struct game g;
+    int sw0 = 1;
+
+    rng_next(&rng);
+    game_start(&g, j->speed, sw0);
+    while (!g.over && g.frames < j->max_frames) {
+        int level = policy_sw0(j->pol, &g, sw0, &rng);
+
+        if (level != sw0) {
+            sw0 = level;
+            game_move(&g, sw0);
+        }
+        game_frame(&g);
+    }
+    s->frames = g.frames;
+    s->coins = g.coins;
+    s->capped = !g.over;
+}
+
+static void *worker(void *arg)
+{
+    struct job *j = arg;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&j->lock);
+        i = j->next;
+        j->next += 64;
+        pthread_mutex_unlock(&j->lock);
+        if (i >= j->sessions)
+            return NULL;
+        for (int k = i; k < i + 64 && k < j->sessions; k++)
+            play_session(j, k, &j->out[k]);
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void print_dist(const char *label, double *v, int n, const char *unit)
+{
+    double sum = 0;
+    int i;
+
+    qsort(v, n, sizeof(v[0]), cmp_double);
+    for (i = 0; i < n; i++)
+        sum += v[i];
+    printf("  %-12s mean %8.1f  p10 %8.1f  p50 %8.1f  p90 %8.1f  max %8.1f %s\n", label,
+           sum / n, v[n / 10], v[n / 2], v[n * 9 / 10], v[n - 1], unit);
+}
+
+// Survival time histogram, 10 buckets up to the limit
+static void print_histogram(const double *secs, int n, double limit)
+{
+    int bucket[11] = { 0 }, i, b, width;
+
+    for (i = 0; i < n; i++) {
+        b = (int)(secs[i] * 10 / limit);
+        bucket[b > 10 ? 10 : b]++;
+    }
+    for (b = 0; b <= 10; b++) {
+        if (!bucket[b])
+            continue;
+        width = bucket[b] * 50 / n;
+        if (b < 10)
+            printf("  %6.0f-%-6.0fs %6d ", limit * b / 10, limit * (b + 1) / 10, bucket[b]);
+        else
+            printf("  %13s %6d ", "limit", bucket[b]);
+        while (width-- > 0)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static int parse_policy(const char *s, struct policy *p)
+{
+    const char *colon = strchr(s, ':');
+    size_t len = colon ? (size_t)(colon - s) : strlen(s);
+
+    snprintf(p->name, sizeof(p->name), "%s", s);
+    p->arg = colon ? atof(colon + 1) : 0;
+    if (len == 4 && !strncmp(s, "stay", 4)) {
+        p->kind = POL_STAY;
+    } else if (len == 6 && !strncmp(s, "toggle", 6)) {
+        p->kind = POL_TOGGLE;
+        if (p->arg < 1)
+            p->arg = GAME_SUBSTEPS * 8;
+    } else if (len == 6 && !strncmp(s, "random", 6)) {
+        p->kind = POL_RANDOM;
+        if (!colon)
+            p->arg = 0.02;
+    } else if (len == 5 && !strncmp(s, "dodge", 5)) {
+        p->kind = POL_DODGE;
+        if (!colon)
+            p->arg = 0.01;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const defaults[] = { "stay", "toggle:40", "random:0.02", "dodge:0.01" };
+    static const char *const speed_name[GAME_SPEEDS] = { "Easy", "Hard" };
+    struct policy pols[16];
+    int npol = 0, sessions = 10000, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), opt, p, speed, t, i;
+    double max_seconds = 600;
+    uint64_t seed = 1, total_frames = 0;
+    struct timespec t0, t1;
+    double wall;
+
+    while ((opt = getopt(argc, argv, "n:j:m:s:")) != -1) {
+        switch (opt) {
+            case 'n': sessions = atoi(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'm': max_seconds = atof(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n sessions] [-j threads] [-m max_seconds] [-s seed] [policy ...]\n", argv[0]);
+                return 2;
+        }
+    }
+    for (i = optind; i < argc && npol < 16; i++)
+        if (!parse_policy(argv[i], &pols[npol++])) {
+            fprintf(stderr, "unknown policy %s\n", argv[i]);
+            return 2;
+        }
+    if (npol == 0)
+        for (i = 0; i < 4; i++)
+            parse_policy(defaults[i], &pols[npol++]);
+    if (sessions < 10)
+        sessions = 10;
+    if (threads < 1)
+        threads = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (speed = 0; speed < GAME_SPEEDS; speed++) {
+        double fps = game_frame_mhz(speed) / 1000.0;
+
+        for (p = 0; p < npol; p++) {
+            struct job j = { &pols[p], speed, sessions, (uint32_t)(max_seconds * fps), seed, NULL, 0,
+                             PTHREAD_MUTEX_INITIALIZER };
+            pthread_t tid[256];
+            double *secs = malloc(sessions * sizeof(double));
+            double *rate = malloc(sessions * sizeof(double));
+            int capped = 0;
+
+            j.out = calloc(sessions, sizeof(struct session));
+            for (t = 0; t < threads && t < 256; t++)
+                pthread_create(&tid[t], NULL, worker, &j);
+            for (t = 0; t < threads && t < 256; t++)
+                pthread_join(tid[t], NULL);
+
+            for (i = 0; i < sessions; i++) {
+                secs[i] = j.out[i].frames / fps;
+                rate[i] = secs[i] > 0 ? j.out[i].coins * 60.0 / secs[i] : 0;
+                capped += j.out[i].capped;
+                total_frames += j.out[i].frames;
+            }
+            printf("%s (%.2f frames/s), policy %s: %d sessions, %.1f%% alive at %.0f s\n",
+                   speed_name[speed], fps, pols[p].name, sessions, 100.0 * capped / sessions, max_seconds);
+            print_histogram(secs, sessions, max_seconds);
+            print_dist("survival", secs, sessions, "s");
+            print_dist("coin rate", rate, sessions, "coins/min");
+            putchar('\n');
+
+            free(secs);
+            free(rate);
+            free(j.out);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%llu frames in %.2f s on %d threads: %.1f M frames/s\n",
+           (unsigned long long)total_frames, wall, threads, total_frames / wall / 1e6);
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Host tool: power-cut campaign for the record store (nvstore.c) on the NOR
+// flash model (nvm_sim.c). Each trial boots the store, checks what it
+// recovered, then runs a random workload of nvs_set() / nvs_service() with a
+// power cut armed at a random flash operation.
+//
+//   cc -O2 -DHAL_SIM -I. -o nvm_powercut tools/nvm_powercut.c nvstore.c nvm_sim.c
+//   ./nvm_powercut [-n trials] [-s seed] [-c max_ops]
+//
+// After a clean flush every key must come back exactly. After a cut each key
+// may hold its last flushed value or any value set after it, never anything
+// else. Prints erase counts per page to show the wear spread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "nvm_sim.h"
+#include "nvstore.h"
+
+#define CAND_MAX  64   // sets per key between two flushes
+
+static const uint32_t defaults[NVS_KEYS] = { [NVS_COINS] = 10, [NVS_OWNED] = 1 };
+
+// Values each key may legally recover to
+static uint32_t cand[NVS_KEYS][CAND_MAX];
+static int ncand[NVS_KEYS];
+
+static uint64_t rng;
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+uint32_t hal_nvm_read(unsigned int word)
+{
+    return nvm_sim_read(word);
+}
+
+int hal_nvm_program(unsigned int word, uint32_t value)
+{
+    return nvm_sim_program(word, value);
+}
+
+int hal_nvm_erase(unsigned int page)
+{
+    return nvm_sim_erase(page);
+}
+
+// Everything is on flash: the current values are the only legal ones
+static void settle(void)
+{
+    int k;
+
+    for (k = 0; k < NVS_KEYS; k++) {
+        cand[k][0] = nvs_get(k);
+        ncand[k] = 1;
+    }
+}
+
+static int check(unsigned long trial)
+{
+    int k, i, ok = 1;
+
+    for (k = 0; k < NVS_KEYS; k++) {
+        for (i = 0; i < ncand[k] && cand[k][i] != nvs_get(k); i++)
+            ;
+        if (i == ncand[k]) {
+            printf("trial %lu: key %d recovered %lu, expected one of %d values from %lu\n", trial, k,
+                   (unsigned long)nvs_get(k), ncand[k], (unsigned long)cand[k][0]);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+static void set(int key, uint32_t value)
+{
+    nvs_set(key, value);
+    if (ncand[key] < CAND_MAX)
+        cand[key][ncand[key]++] = value;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long trials = 10000, t, cuts = 0, recovered = 0, bad = 0, records = 0;
+    unsigned int boot_max = 0, max_ops = 400;
+    unsigned long emin, emax;
+    int opt, k, step, steps;
+
+    rng = 1;
+    while ((opt = getopt(argc, argv, "n:s:c:")) != -1) {
+        switch (opt) {
+            case 'n': trials = strtoul(optarg, NULL, 10); break;
+            case 's': rng = strtoull(optarg, NULL, 10) * 0x9E3779B97F4A7C15ull + 1; break;
+            case 'c': max_ops = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-n trials] [-s seed] [-c max_ops]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    nvm_sim_reset();
+    for (k = 0; k < NVS_KEYS; k++) {
+        cand[k][0] = defaults[k];
+        ncand[k] = 1;
+    }
+
+    for (t = 0; t < trials; t++) {
+        nvm_sim_power_on();
+        nvs_init(defaults);
+        if (!check(t))
+            bad++;
+        if (nvs_get_stats()->recovered)
+            recovered++;
+        if (nvs_get_stats()->boot_words > boot_max)
+            boot_max = nvs_get_stats()->boot_words;
+        settle();
+
+        // Most trials die somewhere in the workload, the rest flush and stop
+        nvm_sim_cut_after(rnd() % 8 ? (long)(rnd() % max_ops) : -1, rnd());
+        steps = 1 + rnd() % 40;
+        for (step = 0; step < steps && nvm_sim_powered(); step++) {
+            k = rnd() % 4 ? NVS_COINS : (int)(rnd() % NVS_KEYS);
+            set(k, k == NVS_COINS ? nvs_get(k) + 1 : rnd());
+            if (rnd() % 4 == 0) {
+                while (nvm_sim_powered() && nvs_service())
+                    ;
+                if (nvm_sim_powered())
+                    settle();
+            } else {
+                for (k = rnd() % 4; k > 0 && nvm_sim_powered(); k--)
+                    nvs_service();
+            }
+        }
+        while (nvm_sim_powered() && nvs_service())
+            ;
+        if (nvm_sim_powered()) {
+            settle();
+            nvm_sim_cut_after(-1, 0);
+        } else {
+            cuts++;
+        }
+        records += nvs_get_stats()->records;
+    }
+
+    emin = emax = nvm_sim_erases(0);
+    for (k = 0; k < HAL_NVM_PAGES; k++) {
+        if (nvm_sim_erases(k) < emin)
+            emin = nvm_sim_erases(k);
+        if (nvm_sim_erases(k) > emax)
+            emax = nvm_sim_erases(k);
+    }
+
+    printf("%lu trials, %lu power cuts, %lu recoveries past damage, %lu bad recoveries\n",
+           trials, cuts, recovered, bad);
+    printf("%lu records, %lu flash operations, boot reads at most %u words\n",
+           records, nvm_sim_ops(), boot_max);
+    printf("erases per page:");
+    for (k = 0; k < HAL_NVM_PAGES; k++)
+        printf(" %lu", nvm_sim_erases(k));
+    printf(" (spread %lu)\n", emax - emin);
+    return bad != 0;
+}
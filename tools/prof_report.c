@@ -0,0 +1,174 @@
+// Host tool: turns a prof_dump() text dump into a flame-style report.
+//
+//   cc -O2 -o prof_report tools/prof_report.c
+//   ./prof_report dump.txt            (or read stdin)
+//
+// Prints the per-region stats, then one line per call stack with its self
+// time in SYSCLK cycles ("frame;render;t5_isr 1234", the folded format
+// flamegraph.pl reads) and an indented tree with inclusive time bars.
+// Interrupts nest under whatever region they preempted, so a region's self
+// time excludes the ISRs that ran inside it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_DEPTH  16
+#define MAX_PATHS  256
+#define NAME_LEN   24
+#define PATH_LEN   (MAX_DEPTH * NAME_LEN)
+#define BAR_WIDTH  40
+
+struct frame {
+    char name[NAME_LEN];
+    uint32_t start;
+    uint64_t children;   // cycles of completed nested regions
+};
+
+struct path {
+    char key[PATH_LEN];
+    int depth;
+    uint64_t self;
+    uint64_t total;
+    unsigned long calls;
+};
+
+static struct frame stack[MAX_DEPTH];
+static int depth;
+static struct path paths[MAX_PATHS];
+static int npaths;
+static unsigned int cycles_per_tick = 2;
+static uint64_t traced;
+
+static struct path *path_get(int upto)
+{
+    char key[PATH_LEN] = "";
+    int i;
+
+    for (i = 0; i <= upto; i++) {
+        if (i)
+            strcat(key, ";");
+        strcat(key, stack[i].name);
+    }
+    for (i = 0; i < npaths; i++)
+        if (strcmp(paths[i].key, key) == 0)
+            return &paths[i];
+    if (npaths == MAX_PATHS) {
+        fprintf(stderr, "prof_report: more than %d call stacks\n", MAX_PATHS);
+        exit(1);
+    }
+    strcpy(paths[npaths].key, key);
+    paths[npaths].depth = upto;
+    return &paths[npaths++];
+}
+
+static void on_begin(const char *name, uint32_t stamp)
+{
+    if (depth == MAX_DEPTH) {
+        fprintf(stderr, "prof_report: nesting deeper than %d\n", MAX_DEPTH);
+        exit(1);
+    }
+    snprintf(stack[depth].name, NAME_LEN, "%s", name);
+    stack[depth].start = stamp;
+    stack[depth].children = 0;
+    depth++;
+}
+
+static void on_end(const char *name, uint32_t stamp)
+{
+    struct path *p;
+    uint64_t cycles;
+    int i;
+
+    // The ring may start inside a region: ends without a begin are dropped,
+    // and so is anything left open above the matching begin
+    for (i = depth - 1; i >= 0; i--)
+        if (strcmp(stack[i].name, name) == 0)
+            break;
+    if (i < 0)
+        return;
+    depth = i;
+
+    cycles = (uint64_t)(uint32_t)(stamp - stack[i].start) * cycles_per_tick;
+    p = path_get(i);
+    p->self += cycles > stack[i].children ? cycles - stack[i].children : 0;
+    p->total += cycles;
+    p->calls++;
+    if (i > 0)
+        stack[i - 1].children += cycles;
+    else
+        traced += cycles;
+}
+
+static int by_key(const void *a, const void *b)
+{
+    return strcmp(((const struct path *)a)->key, ((const struct path *)b)->key);
+}
+
+static int by_self(const void *a, const void *b)
+{
+    const struct path *x = *(const struct path *const *)a, *y = *(const struct path *const *)b;
+
+    return x->self < y->self ? 1 : x->self > y->self ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    char line[256], name[NAME_LEN];
+    unsigned long stamp, count, min, max, mean;
+    struct path *order[MAX_PATHS];
+    int i, j, printed_stats = 0;
+
+    if (argc > 1 && !(in = fopen(argv[1], "r"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        char *p;
+
+        if (line[0] == '#') {
+            if ((p = strstr(line, "cycles_per_tick=")))
+                cycles_per_tick = (unsigned int)strtoul(p + 16, NULL, 10);
+            fputs(line, stdout);
+        } else if (sscanf(line, "S %23s %lu %lu %lu %lu", name, &count, &min, &max, &mean) == 5) {
+            if (!printed_stats++)
+                printf("\n%-14s %10s %10s %10s %10s\n", "region", "count", "min", "mean", "max");
+            printf("%-14s %10lu %10lu %10lu %10lu\n", name, count, min, mean, max);
+        } else if (sscanf(line, "B %lu %23s", &stamp, name) == 2) {
+            on_begin(name, (uint32_t)stamp);
+        } else if (sscanf(line, "E %lu %23s", &stamp, name) == 2) {
+            on_end(name, (uint32_t)stamp);
+        }
+    }
+
+    if (npaths == 0) {
+        printf("\nno complete regions in the trace\n");
+        return 0;
+    }
+
+    printf("\nfolded stacks, self cycles:\n");
+    for (i = 0; i < npaths; i++)
+        order[i] = &paths[i];
+    qsort(order, npaths, sizeof(order[0]), by_self);
+    for (i = 0; i < npaths; i++)
+        printf("%s %llu\n", order[i]->key, (unsigned long long)order[i]->self);
+
+    // Sorted by key, every stack follows its parent
+    printf("\ninclusive cycles, %llu traced at top level:\n", (unsigned long long)traced);
+    qsort(paths, npaths, sizeof(paths[0]), by_key);
+    for (i = 0; i < npaths; i++) {
+        const struct path *p = &paths[i];
+        const char *leaf = strrchr(p->key, ';');
+        int bar = traced ? (int)(p->total * BAR_WIDTH / traced) : 0;
+
+        printf("%*s%-*s %10llu %6lu calls  ", p->depth * 2, "", 20 - p->depth * 2,
+               leaf ? leaf + 1 : p->key, (unsigned long long)p->total, p->calls);
+        for (j = 0; j < bar && j < BAR_WIDTH; j++)
+            putchar('#');
+        putchar('\n');
+    }
+    return 0;
+}
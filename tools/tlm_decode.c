@@ -0,0 +1,128 @@
+// Host tool: decodes a telemetry capture (telemetry.h framing) into text.
+//
+//   cc -O2 -o tlm_decode tools/tlm_decode.c
+//   ./tlm_decode capture.bin         (or read stdin, e.g. a pty or serial port)
+//
+// Resynchronises on the sync byte, checks length and CRC, and prints one line
+// per record followed by counts of good frames, CRC errors and skipped bytes.
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Must match telemetry.h
+#define TLM_SYNC        0xA5
+#define TLM_MAX_PAYLOAD 16
+#define TLM_FRAME       1
+#define TLM_SCORE       2
+#define TLM_ADC         3
+#define TLM_SCORE_COIN  1
+#define TLM_SCORE_BOMB  2
+
+static uint16_t crc16(const unsigned char *p, int n)
+{
+    uint16_t crc = 0xFFFF;
+    int i, b;
+
+    for (i = 0; i < n; i++) {
+        crc ^= (uint16_t)p[i] << 8;
+        for (b = 0; b < 8; b++)
+            crc = crc & 0x8000 ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static unsigned int u16(const unsigned char *p) { return p[0] | p[1] << 8; }
+static unsigned long u32(const unsigned char *p) { return u16(p) | (unsigned long)u16(p + 2) << 16; }
+
+static void print_record(int type, unsigned long us, const unsigned char *p, int len)
+{
+    printf("%10lu.%06lu ", us / 1000000, us % 1000000);
+    if (type == TLM_FRAME && len == 16) {
+        printf("frame  frames=%lu overruns=%lu work_max=%lu busy=%u.%u%% dropped=%u\n",
+               u32(p), u32(p + 4), u32(p + 8), u16(p + 12) / 10, u16(p + 12) % 10, u16(p + 14));
+    } else if (type == TLM_SCORE && len == 4) {
+        printf("score  %s coins=%u row=%u\n",
+               p[0] == TLM_SCORE_COIN ? "coin" : p[0] == TLM_SCORE_BOMB ? "bomb" : "?",
+               u16(p + 1), p[3]);
+    } else if (type == TLM_ADC && len == 4) {
+        printf("adc    raw=%u value=%u\n", u16(p), u16(p + 2));
+    } else {
+        int i;
+
+        printf("type%-3d", type);
+        for (i = 0; i < len; i++)
+            printf(" %02x", p[i]);
+        putchar('\n');
+    }
+}
+
+static unsigned char f[9 + TLM_MAX_PAYLOAD];
+static int n, need = 3;
+static unsigned long good, bad_crc, skipped;
+
+static void feed(unsigned char c)
+{
+    unsigned char rest[9 + TLM_MAX_PAYLOAD];
+    int i, j;
+
+    if (n == 0 && c != TLM_SYNC) {
+        skipped++;
+        return;
+    }
+    f[n++] = c;
+    if (n == 3) {
+        if (f[2] > TLM_MAX_PAYLOAD) {
+            // Not a frame start: drop the sync byte, rescan what followed it
+            rest[0] = f[1];
+            rest[1] = f[2];
+            skipped++;
+            n = 0;
+            feed(rest[0]);
+            feed(rest[1]);
+            return;
+        }
+        need = 9 + f[2];
+    }
+    if (n < need)
+        return;
+
+    if (crc16(f + 1, 6 + f[2]) == u16(f + 7 + f[2])) {
+        print_record(f[1], u32(f + 3), f + 7, f[2]);
+        good++;
+        n = 0;
+        need = 3;
+        return;
+    }
+
+    // Resynchronise on the next sync byte inside the rejected frame. The
+    // bytes from there on go through the header checks again.
+    bad_crc++;
+    for (i = 1; i < n && f[i] != TLM_SYNC; i++)
+        ;
+    skipped += i;
+    for (j = 0; i < n; i++, j++)
+        rest[j] = f[i];
+    n = 0;
+    need = 3;
+    for (i = 0; i < j; i++)
+        feed(rest[i]);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    int c;
+
+    if (argc > 1 && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while ((c = fgetc(in)) != EOF) {
+        feed((unsigned char)c);
+        fflush(stdout);
+    }
+
+    printf("%lu frames, %lu CRC errors, %lu bytes skipped\n", good, bad_crc, skipped);
+    return bad_crc != 0;
+}
@@ -0,0 +1,143 @@
+#include "twheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+
+// Mailbox ring: main() only advances tw_mb_head, Timer5ISR only tw_mb_tail.
+// A command is written in full before the head moves past it.
+struct tw_command {
+    struct tw_timer *timer;
+    uint32_t delay;              // TW_CANCEL: disarm
+    uint32_t period;
+};
+
+#define TW_CANCEL 0xFFFFFFFFu
+
+static struct tw_command tw_mb[TW_MAILBOX_SIZE];
+static volatile unsigned char tw_mb_head;
+static volatile unsigned char tw_mb_tail;
+
+// Wheel state, Timer5 level only
+static struct tw_timer *tw_slot[TW_SLOTS];
+static struct tw_timer *tw_due;  // the slot being expired, detached
+static uint32_t tw_now;          // ticks handled so far
+static struct tw_stats tw_st;
+
+static void tw_unlink(struct tw_timer *t)
+{
+    if (!t->pprev)
+        return;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    *t->pprev = t->next;
+    t->next = 0;
+    t->pprev = 0;
+}
+
+static void tw_link(struct tw_timer **head, struct tw_timer *t)
+{
+    t->next = *head;
+    if (t->next)
+        t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+}
+
+// Fires at tick tw_now + delay; delay 0 counts as 1
+static void tw_insert(struct tw_timer *t, uint32_t delay)
+{
+    if (delay == 0)
+        delay = 1;
+    t->rounds = (delay - 1) >> TW_BITS;
+    tw_link(&tw_slot[(tw_now + delay) & TW_MASK], t);
+}
+
+void tw_arm(struct tw_timer *t, uint32_t delay, uint32_t period)
+{
+    tw_unlink(t);
+    t->period = period;
+    t->fired = 0;
+    tw_insert(t, delay);
+}
+
+void tw_disarm(struct tw_timer *t)
+{
+    tw_unlink(t);
+}
+
+static int tw_post(struct tw_timer *t, uint32_t delay, uint32_t period)
+{
+    unsigned char head = tw_mb_head;
+    unsigned char next = (head + 1) & (TW_MAILBOX_SIZE - 1);
+
+    if (next == tw_mb_tail) {
+        tw_st.dropped++;
+        return 0;
+    }
+    tw_mb[head].timer = t;
+    tw_mb[head].delay = delay;
+    tw_mb[head].period = period;
+    tw_mb_head = next;
+    return 1;
+}
+
+int tw_start(struct tw_timer *t, uint32_t delay, uint32_t period)
+{
+    if (delay == TW_CANCEL)
+        delay--;
+    return tw_post(t, delay, period);
+}
+
+int tw_cancel(struct tw_timer *t)
+{
+    return tw_post(t, TW_CANCEL, 0);
+}
+
+void tw_tick(void)
+{
+    struct tw_timer *t;
+    uint32_t due = 0;
+
+    // At most TW_MAILBOX_SIZE - 1 commands can be waiting
+    while (tw_mb_tail != tw_mb_head) {
+        const struct tw_command *c = &tw_mb[tw_mb_tail];
+
+        if (c->delay == TW_CANCEL)
+            tw_disarm(c->timer);
+        else
+            tw_arm(c->timer, c->delay, c->period);
+        tw_mb_tail = (tw_mb_tail + 1) & (TW_MAILBOX_SIZE - 1);
+        tw_st.commands++;
+    }
+
+    tw_now++;
+    if (!tw_slot[tw_now & TW_MASK])
+        return;
+
+    // Detach the slot, so timers re-armed into it wait for the next revolution
+    // and a callback may disarm any timer still on the due list
+    tw_due = tw_slot[tw_now & TW_MASK];
+    tw_due->pprev = &tw_due;
+    tw_slot[tw_now & TW_MASK] = 0;
+
+    while ((t = tw_due) != 0) {
+        tw_unlink(t);
+        due++;
+        if (t->rounds) {
+            t->rounds--;
+            tw_link(&tw_slot[tw_now & TW_MASK], t);
+            continue;
+        }
+        if (t->period)
+            tw_insert(t, t->period);
+        t->fired++;
+        tw_st.expiries++;
+        t->fn(t);
+    }
+    if (due > tw_st.max_due)
+        tw_st.max_due = due;
+}
+
+const struct tw_stats *tw_get_stats(void)
+{
+    return &tw_st;
+}
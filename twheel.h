@@ -0,0 +1,58 @@
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+// Software timers on the Timer5 tick. A hashed timing wheel of TW_SLOTS
+// doubly-linked lists: insert and cancel are O(1), and each tick only visits
+// the slot whose time has come, so the ISR cost depends on the timers due
+// now, not on how many are pending. A timer further out than one revolution
+// carries a round count and is passed over once per revolution.
+//
+// main() never touches the wheel. tw_start() / tw_cancel() post a command to
+// a single-producer / single-consumer mailbox that tw_tick() drains first,
+// so commands take effect in order on the next tick. Callbacks run inside
+// Timer5ISR and may use tw_arm() / tw_disarm() directly.
+
+#include <stdint.h>
+#include "timebase.h"
+
+#define TW_BITS         8
+#define TW_SLOTS        (1u << TW_BITS)   // 64 ms per revolution
+#define TW_MAILBOX_SIZE 8                 // commands, power of two
+
+#define TW_MS(ms) T5_TICKS_MS(ms)
+
+struct tw_timer;
+typedef void (*tw_fn)(struct tw_timer *t);
+
+struct tw_timer {
+    struct tw_timer *next;
+    struct tw_timer **pprev;     // 0 while not armed
+    uint32_t rounds;             // revolutions left before it fires
+    uint32_t period;             // ticks, 0 = one-shot
+    uint32_t fired;              // expiries since the last start
+    tw_fn fn;
+    void *arg;
+};
+
+#define TW_TIMER(fn, arg) { 0, 0, 0, 0, 0, (fn), (arg) }
+
+struct tw_stats {
+    uint32_t commands;           // mailbox commands applied
+    uint32_t dropped;            // tw_start() / tw_cancel() with the mailbox full
+    uint32_t expiries;           // callbacks run
+    uint32_t max_due;            // most timers handled in one tick
+};
+
+// main(): 0 if the mailbox is full. A delay of 0 or 1 fires on the next tick;
+// starting an armed timer restarts it.
+int tw_start(struct tw_timer *t, uint32_t delay, uint32_t period);
+int tw_cancel(struct tw_timer *t);
+
+// Timer5 level only (callbacks)
+void tw_arm(struct tw_timer *t, uint32_t delay, uint32_t period);
+void tw_disarm(struct tw_timer *t);
+
+void tw_tick(void);              // Timer5ISR
+const struct tw_stats *tw_get_stats(void);
+
+#endif